@@ -0,0 +1,149 @@
+#include "BandwidthGovernor.h"
+
+#include <algorithm>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+namespace {
+
+    // How each level turns a stream down, and roughly what fraction of its
+    // full bandwidth is left. The fractions are only used to predict the
+    // effect of a change, the next measurement gives the real figure.
+    struct Step {
+        // JPEG quality, -1 for the server's default
+        int quality;
+        // Send every nth frame
+        int skip;
+        // Divide the width and height by 2^shift
+        int shift;
+        double cost;
+    };
+
+    const Step kSteps[] = {
+        {-1, 1, 0, 1.0},
+        {60, 1, 0, 0.75},
+        {40, 1, 0, 0.55},
+        {40, 2, 0, 0.28},
+        {40, 2, 1, 0.1},
+        {40, 4, 1, 0.05},
+        {30, 4, 2, 0.015},
+    };
+
+    const int kLevels = sizeof(kSteps) / sizeof(kSteps[0]);
+
+    // Only turn a stream back up if the estimate stays this far under budget
+    const double kHeadroom = 0.85;
+}  // namespace
+
+BandwidthGovernor& BandwidthGovernor::GetInstance() {
+    static BandwidthGovernor instance;
+    return instance;
+}
+
+void BandwidthGovernor::SetBudget(double bytesPerSecond) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_budget = bytesPerSecond;
+}
+
+void BandwidthGovernor::AddStream(const std::shared_ptr<StreamOutput>& stream) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& s : m_streams) {
+        if (s.output.lock() == stream) return;
+    }
+    Stream s;
+    s.output = stream;
+    m_streams.push_back(s);
+}
+
+void BandwidthGovernor::SetLevel(Stream& stream, StreamOutput& output, int level) {
+    const Step& step = kSteps[level];
+    wpi::outs() << "stream '" << output.GetName() << "': bandwidth level " << stream.level
+    << " -> " << level << '\n';
+    output.SetReduction(step.quality, step.skip, step.shift);
+    stream.level = level;
+}
+
+void BandwidthGovernor::Update() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t now = wpi::Now();
+    double seconds = m_lastUpdate != 0 ? (now - m_lastUpdate) * 1.0e-6 : 0.0;
+    m_lastUpdate = now;
+
+    // Hold on to the streams for the update, forgetting the ones that are gone
+    std::vector<std::shared_ptr<StreamOutput>> outputs;
+    for (auto it = m_streams.begin(); it != m_streams.end();) {
+        auto output = it->output.lock();
+        if (!output) {
+            it = m_streams.erase(it);
+            continue;
+        }
+        outputs.push_back(output);
+        ++it;
+    }
+    if (seconds <= 0) return;
+
+    double total = 0;
+    for (size_t i = 0; i < m_streams.size(); ++i) {
+        m_streams[i].rate = outputs[i]->TakeByteRate(seconds);
+        total += m_streams[i].rate;
+    }
+
+    if (m_budget <= 0) {
+        for (size_t i = 0; i < m_streams.size(); ++i) {
+            if (m_streams[i].level != 0) SetLevel(m_streams[i], *outputs[i], 0);
+        }
+    } else if (total > m_budget) {
+        // Turn down the least important streams that are being watched until
+        // the estimate fits, the biggest one first between equals
+        while (total > m_budget) {
+            int victim = -1;
+            for (size_t i = 0; i < m_streams.size(); ++i) {
+                const Stream& s = m_streams[i];
+                if (s.level + 1 >= kLevels || s.rate <= 0) continue;
+                if (victim < 0) {
+                    victim = i;
+                    continue;
+                }
+                int priority = outputs[i]->GetPriority();
+                int victimPriority = outputs[victim]->GetPriority();
+                if (priority < victimPriority || (priority == victimPriority && s.rate > m_streams[victim].rate))
+                    victim = i;
+            }
+            if (victim < 0) break;
+            Stream& s = m_streams[victim];
+            double rate = s.rate * kSteps[s.level + 1].cost / kSteps[s.level].cost;
+            total += rate - s.rate;
+            s.rate = rate;
+            SetLevel(s, *outputs[victim], s.level + 1);
+        }
+    } else {
+        // Give one step back to the most important stream it fits for
+        int best = -1;
+        for (size_t i = 0; i < m_streams.size(); ++i) {
+            const Stream& s = m_streams[i];
+            if (s.level == 0) continue;
+            double rate = s.rate * kSteps[s.level - 1].cost / kSteps[s.level].cost;
+            if (total - s.rate + rate > kHeadroom * m_budget) continue;
+            if (best < 0 || outputs[i]->GetPriority() > outputs[best]->GetPriority()) best = i;
+        }
+        if (best >= 0) SetLevel(m_streams[best], *outputs[best], m_streams[best].level - 1);
+    }
+
+    Publish(total);
+}
+
+void BandwidthGovernor::Publish(double total) {
+    if (!m_table) m_table = nt::NetworkTableInstance::GetDefault().GetTable("CameraBandwidth");
+    // kbit/s, as the field bandwidth limit is given
+    m_table->PutNumber("budget", m_budget * 8.0e-3);
+    m_table->PutNumber("total", total * 8.0e-3);
+    for (auto& s : m_streams) {
+        auto output = s.output.lock();
+        if (!output) continue;
+        auto table = m_table->GetSubTable(output->GetName());
+        table->PutNumber("rate", s.rate * 8.0e-3);
+        table->PutNumber("level", s.level);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <networktables/NetworkTable.h>
+
+#include "StreamOutput.h"
+
+/**
+ * Keeps the dashboard streams together under a bandwidth budget, e.g. the
+ * field radio's bitrate cap.
+ *
+ * cscore does not count the bytes an MjpegServer sends, so each stream
+ * JPEG encodes one of its frames per update at its current quality and its
+ * rate is estimated as that size times the frames it sent (see
+ * StreamOutput::TakeByteRate()).
+ *
+ * Over budget, the lowest priority streams are turned down a step at a time
+ * until the estimate fits: JPEG quality first, then frame rate, then
+ * resolution. Under budget, the highest priority stream that was turned down
+ * is turned back up one step per update, and only if the estimate says it
+ * will still fit with some headroom, so the streams do not oscillate.
+ */
+class BandwidthGovernor {
+    public:
+    static BandwidthGovernor& GetInstance();
+
+    /**
+     * Total for all streams in bytes per second, 0 for no limit.
+     */
+    void SetBudget(double bytesPerSecond);
+
+    /**
+     * Put a stream under the governor. It is dropped again once the stream
+     * is destroyed.
+     */
+    void AddStream(const std::shared_ptr<StreamOutput>& stream);
+
+    /**
+     * Measure the streams and adjust them, then publish the rates to
+     * NetworkTables under CameraBandwidth. Call about once a second.
+     */
+    void Update();
+
+    private:
+    BandwidthGovernor() = default;
+
+    struct Stream {
+        std::weak_ptr<StreamOutput> output;
+        int level = 0;
+        double rate = 0;
+    };
+
+    void SetLevel(Stream& stream, StreamOutput& output, int level);
+    void Publish(double total);
+
+    std::mutex m_mutex;
+    double m_budget = 0;
+    std::vector<Stream> m_streams;
+    uint64_t m_lastUpdate = 0;
+    std::shared_ptr<nt::NetworkTable> m_table;
+};
@@ -0,0 +1,30 @@
+#include "BlobFilter.h"
+
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+void BlobFinder::Find(const cv::Mat& mask, const BlobFilter& filter, std::vector<cv::Rect>& blobs,
+                      cv::Point offset) {
+    blobs.clear();
+    if (mask.empty()) return;
+    // findContours leaves the mask alone since OpenCV 3.2
+    cv::findContours(mask, m_contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, offset);
+    m_found.clear();
+    for (auto& contour : m_contours) {
+        cv::Rect box = cv::boundingRect(contour);
+        double area = cv::contourArea(contour);
+        double ratio = box.width / static_cast<double>(box.height);
+        if (area < filter.minArea || area > filter.maxArea) continue;
+        if (box.width < filter.minWidth || box.width > filter.maxWidth) continue;
+        if (box.height < filter.minHeight || box.height > filter.maxHeight) continue;
+        if (ratio < filter.minRatio || ratio > filter.maxRatio) continue;
+        m_found.emplace_back(area, box);
+    }
+    std::sort(m_found.begin(), m_found.end(),
+              [](const std::pair<double, cv::Rect>& a, const std::pair<double, cv::Rect>& b) {
+                  return a.first > b.first;
+              });
+    size_t count = std::min(m_found.size(), static_cast<size_t>(std::max(0, filter.maxBlobs)));
+    for (size_t i = 0; i < count; ++i) blobs.push_back(m_found[i].second);
+}
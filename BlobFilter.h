@@ -0,0 +1,51 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Which blobs of a mask count as targets, like GRIP's filter contours step.
+ * Areas are contour areas in pixels of the mask, ratio is width / height of
+ * the bounding box.
+ */
+struct BlobFilter {
+    double minArea = 0;
+    double maxArea = 1e9;
+    int minWidth = 0;
+    int maxWidth = 1000000;
+    int minHeight = 0;
+    int maxHeight = 1000000;
+    double minRatio = 0;
+    double maxRatio = 1e9;
+    // Largest blobs kept
+    int maxBlobs = 10;
+
+    bool operator==(const BlobFilter& other) const {
+        return minArea == other.minArea && maxArea == other.maxArea && minWidth == other.minWidth &&
+               maxWidth == other.maxWidth && minHeight == other.minHeight && maxHeight == other.maxHeight &&
+               minRatio == other.minRatio && maxRatio == other.maxRatio && maxBlobs == other.maxBlobs;
+    }
+    bool operator!=(const BlobFilter& other) const { return !(*this == other); }
+};
+
+/**
+ * Finds the blobs of a mask that pass a BlobFilter. Keeps its scratch
+ * vectors, so finding blobs frame after frame does not allocate once they
+ * have grown to size.
+ */
+class BlobFinder {
+    public:
+    /**
+     * Bounding boxes of the outer contours of mask (CV_8UC1) that pass
+     * filter, largest area first, moved by offset, e.g. the corner of the
+     * region of interest mask was taken from.
+     */
+    void Find(const cv::Mat& mask, const BlobFilter& filter, std::vector<cv::Rect>& blobs,
+              cv::Point offset = cv::Point());
+
+    private:
+    std::vector<std::vector<cv::Point>> m_contours;
+    std::vector<std::pair<double, cv::Rect>> m_found;
+};
@@ -0,0 +1,175 @@
+#include "BoxDownscale.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BOX_DOWNSCALE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define BOX_DOWNSCALE_SSE2 1
+#endif
+
+namespace {
+
+    // Each output row is made in two passes: the n input rows are added into
+    // a row of 16 bit sums (a 4x4 block of 255s still fits), then every n
+    // neighbouring pixels of that are added and divided by the block area.
+
+    void SumRows(const uint8_t* const* rows, int n, uint16_t* sums, int count) {
+        int i = 0;
+#if BOX_DOWNSCALE_NEON
+        for (; i + 16 <= count; i += 16) {
+            uint8x16_t v = vld1q_u8(rows[0] + i);
+            uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+            uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+            for (int k = 1; k < n; ++k) {
+                v = vld1q_u8(rows[k] + i);
+                lo = vaddw_u8(lo, vget_low_u8(v));
+                hi = vaddw_u8(hi, vget_high_u8(v));
+            }
+            vst1q_u16(sums + i, lo);
+            vst1q_u16(sums + i + 8, hi);
+        }
+#elif BOX_DOWNSCALE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= count; i += 16) {
+            __m128i lo = zero;
+            __m128i hi = zero;
+            for (int k = 0; k < n; ++k) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i));
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i + 8), hi);
+        }
+#endif
+        for (; i < count; ++i) {
+            unsigned sum = 0;
+            for (int k = 0; k < n; ++k) sum += rows[k][i];
+            sums[i] = static_cast<uint16_t>(sum);
+        }
+    }
+
+#if BOX_DOWNSCALE_NEON
+    // Adds neighbouring lanes: a0+a1, a2+a3, ..., b6+b7
+    inline uint16x8_t PairSum(uint16x8_t a, uint16x8_t b) {
+        return vcombine_u16(vpadd_u16(vget_low_u16(a), vget_high_u16(a)),
+                            vpadd_u16(vget_low_u16(b), vget_high_u16(b)));
+    }
+
+    // Returns how many output pixels were done, 8 at a time
+    template <int kShift>
+    int SumColumnsSimd(const uint16_t* sums, uint8_t* out, int pixels, int cn) {
+        const int n = kShift == 2 ? 2 : 4;
+        int x = 0;
+        if (cn == 1) {
+            for (; x + 8 <= pixels; x += 8) {
+                const uint16_t* s = sums + x * n;
+                uint16x8_t sum = PairSum(vld1q_u16(s), vld1q_u16(s + 8));
+                if (n == 4) sum = PairSum(sum, PairSum(vld1q_u16(s + 16), vld1q_u16(s + 24)));
+                vst1_u8(out + x, vrshrn_n_u16(sum, kShift));
+            }
+        } else if (cn == 3) {
+            // vld3 splits the channels so they can be added like gray
+            for (; x + 8 <= pixels; x += 8) {
+                const uint16_t* s = sums + x * n * 3;
+                uint16x8x3_t a = vld3q_u16(s);
+                uint16x8x3_t b = vld3q_u16(s + 24);
+                uint8x8x3_t result;
+                if (n == 2) {
+                    for (int c = 0; c < 3; ++c)
+                        result.val[c] = vrshrn_n_u16(PairSum(a.val[c], b.val[c]), kShift);
+                } else {
+                    uint16x8x3_t d = vld3q_u16(s + 48);
+                    uint16x8x3_t e = vld3q_u16(s + 72);
+                    for (int c = 0; c < 3; ++c) {
+                        uint16x8_t sum = PairSum(PairSum(a.val[c], b.val[c]), PairSum(d.val[c], e.val[c]));
+                        result.val[c] = vrshrn_n_u16(sum, kShift);
+                    }
+                }
+                vst3_u8(out + x * 3, result);
+            }
+        }
+        return x;
+    }
+#elif BOX_DOWNSCALE_SSE2
+    inline __m128i Load(const uint16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+    // Adds neighbouring lanes: a0+a1, a2+a3, ..., b6+b7. The sums are small
+    // enough for the signed multiply-add and pack.
+    inline __m128i PairSum(__m128i a, __m128i b) {
+        const __m128i ones = _mm_set1_epi16(1);
+        return _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+    }
+
+    // Returns how many output pixels were done, 16 at a time. SSE2 has no
+    // cheap way to split up 3 byte pixels so BGR is left to the scalar loop,
+    // it still gets the vectorised row sums.
+    template <int kShift>
+    int SumColumnsSimd(const uint16_t* sums, uint8_t* out, int pixels, int cn) {
+        if (cn != 1) return 0;
+        const int n = kShift == 2 ? 2 : 4;
+        const __m128i round = _mm_set1_epi16(1 << (kShift - 1));
+        int x = 0;
+        for (; x + 16 <= pixels; x += 16) {
+            __m128i half[2];
+            for (int h = 0; h < 2; ++h) {
+                const uint16_t* s = sums + (x + h * 8) * n;
+                __m128i sum = PairSum(Load(s), Load(s + 8));
+                if (n == 4) sum = PairSum(sum, PairSum(Load(s + 16), Load(s + 24)));
+                half[h] = _mm_srli_epi16(_mm_add_epi16(sum, round), kShift);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(half[0], half[1]));
+        }
+        return x;
+    }
+#else
+    template <int kShift>
+    int SumColumnsSimd(const uint16_t*, uint8_t*, int, int) { return 0; }
+#endif
+
+    template <int kShift>
+    void SumColumns(const uint16_t* sums, uint8_t* out, int pixels, int cn) {
+        const int n = kShift == 2 ? 2 : 4;
+        for (int x = SumColumnsSimd<kShift>(sums, out, pixels, cn); x < pixels; ++x) {
+            for (int c = 0; c < cn; ++c) {
+                unsigned sum = 0;
+                for (int k = 0; k < n; ++k) sum += sums[(x * n + k) * cn + c];
+                out[x * cn + c] = static_cast<uint8_t>((sum + (1 << (kShift - 1))) >> kShift);
+            }
+        }
+    }
+}  // namespace
+
+bool boxDownscale(const cv::Mat& src, cv::Mat& dst, cv::Size size) {
+    int cn = src.channels();
+    if (src.depth() != CV_8U || (cn != 1 && cn != 3)) return false;
+    if (size.width <= 0 || size.height <= 0) return false;
+    int n = src.cols / size.width;
+    if ((n != 2 && n != 4) || src.cols != size.width * n || src.rows != size.height * n) return false;
+
+    dst.create(size, src.type());
+    // One row of sums per thread, only grows if the frames do
+    thread_local std::vector<uint16_t> sums;
+    sums.resize(src.cols * cn);
+
+    const uint8_t* rows[4];
+    for (int y = 0; y < size.height; ++y) {
+        for (int k = 0; k < n; ++k) rows[k] = src.ptr<uint8_t>(y * n + k);
+        SumRows(rows, n, sums.data(), src.cols * cn);
+        if (n == 2)
+            SumColumns<2>(sums.data(), dst.ptr<uint8_t>(y), size.width, cn);
+        else
+            SumColumns<4>(sums.data(), dst.ptr<uint8_t>(y), size.width, cn);
+    }
+    return true;
+}
+
+void areaDownscale(const cv::Mat& src, cv::Mat& dst, cv::Size size) {
+    if (!boxDownscale(src, dst, size)) cv::resize(src, dst, size, 0.0, 0.0, cv::INTER_AREA);
+}
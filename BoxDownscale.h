@@ -0,0 +1,21 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Shrink src to size by averaging every n x n block of pixels, for n of 2 or
+ * 4. This is what cv::resize with INTER_AREA does for those ratios (apart
+ * from how exact halves are rounded), but with a kernel written for them that
+ * uses NEON or SSE2 when the compiler targets it.
+ *
+ * Returns false without touching dst if src is not 8 bit gray or BGR, or is
+ * not exactly 2 or 4 times size in both directions, so the caller can fall
+ * back to cv::resize.
+ */
+bool boxDownscale(const cv::Mat& src, cv::Mat& dst, cv::Size size);
+
+/**
+ * Resize src to size with boxDownscale() when it can, cv::resize with
+ * INTER_AREA otherwise.
+ */
+void areaDownscale(const cv::Mat& src, cv::Mat& dst, cv::Size size);
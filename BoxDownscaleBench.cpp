@@ -0,0 +1,68 @@
+/*
+   Times areaDownscale() against the cv::resize with INTER_AREA it stands in
+   for, at the ratios the streams and pyramid use, and checks the two agree.
+   Built with "make bench", run on the Pi:
+
+       ./boxDownscaleBench
+
+   Halves are rounded differently, so pixels may differ by 1. Exits 1 if any
+   pixel differs by more.
+ */
+
+#include <cstdint>
+#include <cstdio>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "BoxDownscale.h"
+
+namespace {
+
+    const int kRuns = 500;
+
+    struct Case {
+        cv::Size from;
+        cv::Size to;
+        int type;
+    };
+
+    template <typename Resize>
+    double Time(const cv::Mat& src, cv::Mat& dst, Resize resize) {
+        // Warm up, so dst is allocated before timing
+        resize(src, dst);
+        int64_t start = cv::getTickCount();
+        for (int i = 0; i < kRuns; ++i) resize(src, dst);
+        return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() / kRuns;
+    }
+}  // namespace
+
+int main() {
+    const Case cases[] = {{cv::Size(640, 480), cv::Size(320, 240), CV_8UC3},
+                          {cv::Size(640, 480), cv::Size(160, 120), CV_8UC3},
+                          {cv::Size(320, 240), cv::Size(160, 120), CV_8UC3},
+                          {cv::Size(640, 480), cv::Size(320, 240), CV_8UC1},
+                          {cv::Size(640, 480), cv::Size(160, 120), CV_8UC1}};
+    bool same = true;
+    cv::RNG rng(2019);
+    for (auto& c : cases) {
+        cv::Mat src(c.from, c.type);
+        rng.fill(src, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+        cv::Mat area, box;
+        double areaTime = Time(src, area, [&](const cv::Mat& s, cv::Mat& d) {
+            cv::resize(s, d, c.to, 0, 0, cv::INTER_AREA);
+        });
+        double boxTime = Time(src, box, [&](const cv::Mat& s, cv::Mat& d) { areaDownscale(s, d, c.to); });
+
+        cv::Mat diff;
+        cv::absdiff(area, box, diff);
+        double maxDiff = 0;
+        cv::minMaxLoc(diff.reshape(1), nullptr, &maxDiff);
+        if (maxDiff > 1) same = false;
+
+        std::printf("%dx%d -> %dx%d %s: INTER_AREA %.3f ms, areaDownscale %.3f ms, %.2fx, max diff %.0f\n",
+                    c.from.width, c.from.height, c.to.width, c.to.height, c.type == CV_8UC3 ? "bgr" : "gray",
+                    areaTime, boxTime, areaTime / boxTime, maxDiff);
+    }
+    return same ? 0 : 1;
+}
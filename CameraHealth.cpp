@@ -0,0 +1,86 @@
+#include "CameraHealth.h"
+
+#include <algorithm>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+CameraHealth::CameraHealth(const std::string& camera)
+    : m_camera(camera),
+      m_table(nt::NetworkTableInstance::GetDefault().GetTable("CameraHealth")->GetSubTable(camera)) {}
+
+const char* CameraHealth::GetStateName(State state) {
+    switch (state) {
+        case kStreaming: return "streaming";
+        case kDegraded: return "degraded";
+        case kDisconnected: return "disconnected";
+        case kReconnecting: return "reconnecting";
+    }
+    return "unknown";
+}
+
+void CameraHealth::SetState(State state) {
+    wpi::outs() << "camera '" << m_camera << "': " << GetStateName(GetState())
+    << " -> " << GetStateName(state) << '\n';
+    m_state.store(state, std::memory_order_relaxed);
+}
+
+bool CameraHealth::FrameFailed(bool connected) {
+    ++m_failures;
+    if (m_downSince == 0) m_downSince = wpi::Now();
+
+    switch (GetState()) {
+        case kStreaming:
+            if (connected && m_failures < kDisconnectAfter) {
+                SetState(kDegraded);
+            } else {
+                SetState(kDisconnected);
+            }
+            return true;
+        case kDegraded:
+            if (!connected || m_failures >= kDisconnectAfter) {
+                SetState(kDisconnected);
+                return true;
+            }
+            return false;
+        case kReconnecting:
+            // Still not back, wait longer before the next try
+            m_backoff = std::min(m_backoff * 2, kMaxBackoff);
+            SetState(kDisconnected);
+            return false;
+        case kDisconnected:
+            return false;
+    }
+    return false;
+}
+
+bool CameraHealth::FrameGrabbed() {
+    m_failures = 0;
+    State state = GetState();
+    if (state == kStreaming) return false;
+
+    if (state == kReconnecting) m_reconnects.fetch_add(1, std::memory_order_relaxed);
+    uint64_t since = m_downSince.exchange(0);
+    if (since != 0) m_downtime.fetch_add(wpi::Now() - since, std::memory_order_relaxed);
+    m_backoff = kMinBackoff;
+    SetState(kStreaming);
+    return true;
+}
+
+void CameraHealth::Reconnecting() {
+    if (GetState() == kDisconnected) SetState(kReconnecting);
+}
+
+uint64_t CameraHealth::GetDowntime() const {
+    uint64_t downtime = m_downtime.load(std::memory_order_relaxed);
+    uint64_t since = m_downSince.load(std::memory_order_relaxed);
+    if (since != 0) downtime += wpi::Now() - since;
+    return downtime;
+}
+
+void CameraHealth::Publish() {
+    m_table->PutString("state", GetStateName(GetState()));
+    m_table->PutNumber("reconnects", GetReconnects());
+    m_table->PutNumber("downtime", GetDowntime() * 1.0e-6);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <networktables/NetworkTable.h>
+
+/**
+ * Tracks whether a camera is delivering frames.
+ *
+ *  - streaming: frames are arriving
+ *  - degraded: grabs are failing but the camera still says it is connected
+ *  - disconnected: the camera is gone, nothing is grabbed until it comes back
+ *    or the back off runs out
+ *  - reconnecting: trying a grab again after a disconnect
+ *
+ * Every failed reconnect doubles the back off. The reconnect count and the
+ * total time spent not streaming are published to NetworkTables under
+ * CameraHealth/<camera>.
+ */
+class CameraHealth {
+    public:
+    enum State { kStreaming, kDegraded, kDisconnected, kReconnecting };
+
+    explicit CameraHealth(const std::string& camera);
+
+    /**
+     * A grab failed. connected is what the camera reports.
+     *
+     * @return true if the state changed, so the error should be passed on
+     */
+    bool FrameFailed(bool connected);
+
+    /**
+     * A grab succeeded.
+     *
+     * @return true if the state changed
+     */
+    bool FrameGrabbed();
+
+    /**
+     * Done waiting while disconnected, the next grab is a reconnect attempt.
+     */
+    void Reconnecting();
+
+    State GetState() const { return m_state.load(std::memory_order_relaxed); }
+    static const char* GetStateName(State state);
+
+    /**
+     * How long to wait before the next reconnect attempt, in microseconds.
+     */
+    uint64_t GetBackoff() const { return m_backoff; }
+
+    uint64_t GetReconnects() const { return m_reconnects.load(std::memory_order_relaxed); }
+
+    /**
+     * Total time spent not streaming in microseconds, including the current
+     * outage.
+     */
+    uint64_t GetDowntime() const;
+
+    void Publish();
+
+    private:
+    void SetState(State state);
+
+    static constexpr int kDisconnectAfter = 3;
+    static constexpr uint64_t kMinBackoff = 250000;
+    static constexpr uint64_t kMaxBackoff = 8000000;
+
+    std::string m_camera;
+    std::atomic<State> m_state{kStreaming};
+    int m_failures = 0;
+    uint64_t m_backoff = kMinBackoff;
+
+    std::atomic<uint64_t> m_reconnects{0};
+    std::atomic<uint64_t> m_downtime{0};
+    // wpi::Now() when the current outage started, 0 while streaming
+    std::atomic<uint64_t> m_downSince{0};
+
+    std::shared_ptr<nt::NetworkTable> m_table;
+};
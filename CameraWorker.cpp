@@ -0,0 +1,200 @@
+#include "CameraWorker.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+
+#include <wpi/raw_ostream.h>
+
+#include "cameraserver/CameraServer.h"
+#include "BandwidthGovernor.h"
+
+namespace {
+
+    // Pin the calling thread to a single core
+    void PinToCore(const std::string& name, int core) {
+        int cores = std::thread::hardware_concurrency();
+        if (core >= cores) {
+            wpi::errs() << "worker '" << name << "': core " << core
+            << " does not exist, only " << cores << " available\n";
+            return;
+        }
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core, &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err != 0) {
+            wpi::errs() << "worker '" << name << "': could not pin to core "
+            << core << " (error " << err << ")\n";
+        }
+    }
+}  // namespace
+
+CameraWorker::CameraWorker(const cs::VideoSource& camera, const WorkerConfig& config)
+    : m_camera(camera), m_config(config), m_hub(camera, camera.GetName(), config.decimate) {
+    if (m_config.frameRateDivider < 1) m_config.frameRateDivider = 1;
+    ApplySchedule();
+}
+
+CameraWorker::CameraWorker(const std::string& name, const std::string& path, const cs::VideoMode& mode,
+                           const WorkerConfig& config)
+    : m_config(config), m_hub(cs::VideoSource(), name, config.decimate) {
+    if (m_config.frameRateDivider < 1) m_config.frameRateDivider = 1;
+    m_hub.SetRawDevice(path, mode);
+    ApplySchedule();
+}
+
+CameraWorker::~CameraWorker() {
+    Stop();
+    StopOutput(true);
+}
+
+void CameraWorker::Start() {
+    if (m_running) return;
+    m_running = true;
+    StartOutput();
+    m_hub.Start();
+}
+
+void CameraWorker::Stop() {
+    if (!m_running) return;
+    m_running = false;
+    m_hub.Stop();
+    StopOutput(false);
+}
+
+void CameraWorker::SetConfig(const WorkerConfig& config) {
+    WorkerConfig old = m_config;
+    m_config = config;
+    if (m_config.frameRateDivider < 1) m_config.frameRateDivider = 1;
+
+    if (m_config.core != old.core || m_config.schedule != old.schedule) {
+        // Threads only pick up their scheduling when they start
+        ApplySchedule();
+        m_hub.Restart();
+    }
+    if (m_config.decimate != old.decimate) m_hub.SetDecimate(m_config.decimate);
+
+    bool passThrough = m_config.passThrough && CanPassThrough();
+    if (m_config.name != old.name || (m_running && passThrough != IsPassThrough())) {
+        // The dashboard stream itself has to be replaced, under its old name
+        std::string name = m_config.name;
+        m_config.name = old.name;
+        StopOutput(true);
+        m_config.name = name;
+        if (m_running) StartOutput();
+        return;
+    }
+    if (!m_running) return;
+
+    if (IsPassThrough()) {
+        int fps = m_camera.GetVideoMode().fps;
+        m_server.SetFPS(m_config.frameRateDivider > 1 && fps > 0 ? std::max(1, fps / m_config.frameRateDivider) : 0);
+    } else if (m_output) {
+        if (m_config.width != old.width || m_config.height != old.height ||
+            m_config.crop != old.crop || m_config.overlays != old.overlays) {
+            m_output->SetLayout(m_config.width, m_config.height, m_config.crop, m_config.overlays);
+            // The pyramid sizes may have changed
+            m_hub.ConsumersChanged();
+        }
+        m_output->SetPriority(m_config.priority);
+        m_output->SetSkipStatic(m_config.skipStatic, m_config.keepAlive);
+        // Otherwise left to the dashboard
+        if (m_config.gray != old.gray) m_output->SetGray(m_config.gray);
+        if (m_config.frameRateDivider != old.frameRateDivider) {
+            m_output->SetDivider(m_config.frameRateDivider);
+            m_hub.ConsumersChanged();
+        }
+    }
+}
+
+void CameraWorker::CameraChanged() {
+    if (!m_running) return;
+    bool passThrough = m_config.passThrough && CanPassThrough();
+    if (passThrough == IsPassThrough()) return;
+    StopOutput(true);
+    StartOutput();
+}
+
+void CameraWorker::ApplySchedule() {
+    std::string name = m_config.name;
+    int core = m_config.core;
+    m_hub.SetThreadInit([name, core] {
+        if (core >= 0) PinToCore(name, core);
+    });
+    m_hub.SetSchedulePolicy(m_config.schedule);
+}
+
+void CameraWorker::StartOutput() {
+    if (m_config.passThrough && CanPassThrough()) {
+        StartPassThrough();
+        return;
+    }
+    if (!m_output) {
+        std::atomic_store(&m_output, std::make_shared<StreamOutput>(m_config.name, m_config.width, m_config.height,
+                                                                    m_config.frameRateDivider, m_config.crop, m_config.overlays));
+        m_output->SetPriority(m_config.priority);
+        m_output->SetSkipStatic(m_config.skipStatic, m_config.keepAlive);
+        m_output->SetGray(m_config.gray);
+        BandwidthGovernor::GetInstance().AddStream(m_output);
+    }
+    m_hub.AddConsumer(m_output);
+}
+
+void CameraWorker::StopOutput(bool remove) {
+    auto inst = frc::CameraServer::GetInstance();
+    if (m_output) {
+        m_hub.RemoveConsumer(m_output);
+        if (remove) {
+            // Take the stream off the dashboard too
+            inst->RemoveServer("serve_" + m_config.name);
+            inst->RemoveCamera(m_config.name);
+            std::atomic_store(&m_output, std::shared_ptr<StreamOutput>());
+        }
+    }
+    if (IsPassThrough()) {
+        inst->RemoveServer(m_server.GetName());
+        m_server = cs::MjpegServer();
+    }
+}
+
+bool CameraWorker::CanPassThrough() const {
+    if (m_camera.GetHandle() == 0) {
+        wpi::errs() << "worker '" << m_config.name
+        << "': pass-through needs cscore to capture the camera, decoding instead\n";
+        return false;
+    }
+    if (m_config.crop.area() > 0 || !m_config.overlays.empty() || m_config.gray) {
+        wpi::errs() << "worker '" << m_config.name
+        << "': pass-through cannot crop, draw overlays or send gray, decoding instead\n";
+        return false;
+    }
+    cs::VideoMode mode = m_camera.GetVideoMode();
+    if (mode.pixelFormat != cs::VideoMode::kMJPEG) {
+        wpi::errs() << "worker '" << m_config.name
+        << "': pass-through needs an MJPEG camera, decoding instead\n";
+        return false;
+    }
+    if (mode.width != m_config.width || mode.height != m_config.height) {
+        wpi::errs() << "worker '" << m_config.name << "': camera is "
+        << mode.width << "x" << mode.height << " but output is "
+        << m_config.width << "x" << m_config.height
+        << ", pass-through needs them to match, decoding instead\n";
+        return false;
+    }
+    return true;
+}
+
+void CameraWorker::StartPassThrough() {
+    wpi::outs() << "worker '" << m_config.name << "': passing camera MJPEG through\n";
+    m_server = frc::CameraServer::GetInstance()->AddServer("serve_" + m_config.name);
+    m_server.SetSource(m_camera);
+
+    // The server skips frames itself. Leaving resolution and compression unset
+    // is what lets it send the camera's JPEG data unchanged.
+    int fps = m_camera.GetVideoMode().fps;
+    if (m_config.frameRateDivider > 1 && fps > 0)
+        m_server.SetFPS(std::max(1, fps / m_config.frameRateDivider));
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cscore.h>
+
+#include "FrameHub.h"
+#include "Scheduler.h"
+#include "StreamOutput.h"
+
+/**
+ * Per camera output settings. These come from the optional "output" object of
+ * a camera in /boot/frc.json, anything missing keeps the default below.
+ */
+struct WorkerConfig {
+    // Name of the stream sent back to the dashboard
+    std::string name;
+    // Output resolution
+    int width = 320;
+    int height = 240;
+    // Part of the camera image to send, empty for all of it
+    cv::Rect crop;
+    // Crosshairs etc. drawn on the output
+    std::vector<Overlay> overlays;
+    // Send luma only, until the dashboard switches it back
+    bool gray = false;
+    // Only every nth camera frame is sent to the dashboard
+    int frameRateDivider = 2;
+    // Higher priority streams are turned down last to stay in the bandwidth
+    // budget
+    int priority = 0;
+    // Do not send frames that look the same as the last one sent, but still
+    // send one every keepAlive ms
+    bool skipStatic = false;
+    int keepAlive = 1000;
+    // Skip unwanted frames before they are decoded instead of after
+    bool decimate = true;
+    // Forward the camera's own JPEG frames to the dashboard without decoding
+    // them. Only possible when the camera streams MJPEG at the output size,
+    // with no crop, overlays or gray.
+    bool passThrough = false;
+    // CPU core to pin the worker threads to, -1 lets the scheduler decide
+    int core = -1;
+    // Priorities and deadline of the worker threads
+    SchedulePolicy schedule;
+};
+
+/**
+ * Owns the processing for a single camera. Frames are grabbed by the camera's
+ * FrameHub and shared between the dashboard stream and any other consumers,
+ * such as vision pipelines. One worker is created for every camera in the
+ * config file.
+ *
+ * In pass-through mode the dashboard stream is an MJPEG server fed straight
+ * from the camera that skips frames itself, so nothing is decoded or
+ * re-encoded. The hub then only runs for the other consumers.
+ */
+class CameraWorker {
+    public:
+    CameraWorker(const cs::VideoSource& camera, const WorkerConfig& config);
+
+    /**
+     * Capture YUYV frames from the V4L2 device at path directly, see
+     * YuyvCapture. Consumers get CV_8UC2 frames and pass-through is not
+     * possible.
+     */
+    CameraWorker(const std::string& name, const std::string& path, const cs::VideoMode& mode,
+                 const WorkerConfig& config);
+    ~CameraWorker();
+
+    CameraWorker(const CameraWorker&) = delete;
+    CameraWorker& operator=(const CameraWorker&) = delete;
+
+    /**
+     * Start the worker. Does nothing if it is already running.
+     */
+    void Start();
+
+    /**
+     * Stop the worker and wait for it to finish the current frame.
+     */
+    void Stop();
+
+    /**
+     * Apply a new output config to a running worker. Size and divider are
+     * changed in place, the threads are only restarted for scheduling changes
+     * and the dashboard stream is only replaced if its name or pass-through
+     * mode changes.
+     */
+    void SetConfig(const WorkerConfig& config);
+
+    /**
+     * Check again whether pass-through is possible, e.g. after the camera video
+     * mode was changed, and switch modes if needed.
+     */
+    void CameraChanged();
+
+    /**
+     * Share the camera frames with another consumer, e.g. a PipelineConsumer.
+     */
+    void AddConsumer(const std::shared_ptr<FrameConsumer>& consumer) { m_hub.AddConsumer(consumer); }
+    void RemoveConsumer(const std::shared_ptr<FrameConsumer>& consumer) { m_hub.RemoveConsumer(consumer); }
+
+    /**
+     * Boxes, in camera pixels, to draw on the dashboard stream if its overlays
+     * include targets. Typically called from a pipeline's listener, on a
+     * thread of its own.
+     */
+    void SetTargets(const std::vector<cv::Rect>& targets) {
+        std::shared_ptr<StreamOutput> output = std::atomic_load(&m_output);
+        if (output) output->SetTargets(targets);
+    }
+
+    const WorkerConfig& GetConfig() const { return m_config; }
+    FrameHub& GetHub() { return m_hub; }
+
+    /**
+     * What the dashboard stream shows: the camera itself in pass-through mode,
+     * otherwise the decoded and scaled output. Empty while stopped. Changes
+     * when the output is replaced, e.g. by SetConfig().
+     */
+    cs::VideoSource GetStreamSource() const {
+        if (IsPassThrough()) return m_camera;
+        std::shared_ptr<StreamOutput> output = std::atomic_load(&m_output);
+        return output ? cs::VideoSource(output->GetSource()) : cs::VideoSource();
+    }
+
+    /**
+     * Publish the camera health, the latency of the camera's streams and
+     * pipelines since the last call and how many frames each of them got or
+     * missed to NetworkTables.
+     */
+    void PublishMetrics() {
+        m_hub.GetHealth().Publish();
+        m_hub.GetLatencyTracker().Publish();
+        m_hub.PublishStats();
+        auto output = std::atomic_load(&m_output);
+        if (output) output->Publish();
+    }
+
+    /**
+     * True if the camera frames are forwarded without being decoded.
+     */
+    bool IsPassThrough() const { return m_server.GetHandle() != 0; }
+
+    private:
+    void ApplySchedule();
+    bool CanPassThrough() const;
+    void StartOutput();
+    void StopOutput(bool remove);
+    void StartPassThrough();
+
+    cs::VideoSource m_camera;
+    WorkerConfig m_config;
+    FrameHub m_hub;
+    // Written with std::atomic_store so SetTargets() can read it from any thread
+    std::shared_ptr<StreamOutput> m_output;
+    cs::MjpegServer m_server;
+    bool m_running = false;
+};
@@ -0,0 +1,48 @@
+#include "ChangeDetector.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+ChangeDetector::ChangeDetector(int threshold, double fraction)
+    : m_threshold(threshold), m_fraction(fraction) {}
+
+bool ChangeDetector::Changed(const cv::Mat& image) {
+    CV_Assert(image.depth() == CV_8U);
+    int cn = image.channels();
+    int columns = std::min(kColumns, image.cols);
+    int rows = std::min(kRows, image.rows);
+    m_samples.resize(columns * rows * cn);
+
+    uint8_t* sample = m_samples.data();
+    for (int r = 0; r < rows; ++r) {
+        // Centre of each grid cell
+        const uint8_t* row = image.ptr<uint8_t>((2 * r + 1) * image.rows / (2 * rows));
+        for (int c = 0; c < columns; ++c) {
+            const uint8_t* pixel = row + ((2 * c + 1) * image.cols / (2 * columns)) * cn;
+            for (int k = 0; k < cn; ++k) *sample++ = pixel[k];
+        }
+    }
+    m_sampled = true;
+
+    bool sameFormat = image.size() == m_size && image.type() == m_type;
+    m_size = image.size();
+    m_type = image.type();
+    if (!m_haveReference || !sameFormat) return true;
+
+    int changed = 0;
+    int limit = static_cast<int>(m_fraction * columns * rows);
+    const uint8_t* a = m_samples.data();
+    const uint8_t* b = m_reference.data();
+    for (int i = 0; i < columns * rows; ++i) {
+        int difference = 0;
+        for (int k = 0; k < cn; ++k, ++a, ++b) difference += std::abs(*a - *b);
+        if (difference > m_threshold && ++changed > limit) return true;
+    }
+    return false;
+}
+
+void ChangeDetector::Accept() {
+    if (!m_sampled) return;
+    m_reference.swap(m_samples);
+    m_haveReference = true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Tells whether a frame looks different from the last one that was sent,
+ * cheaply enough to run on every frame of a stream.
+ *
+ * Only a fixed grid of pixels is compared, whatever the frame size. A
+ * sample has changed if its channels differ from the reference by more than
+ * the threshold in total, which sensor noise on a still scene does not get
+ * to. The frame has changed if more than a fraction of the samples have, so
+ * something small moving into view still counts.
+ */
+class ChangeDetector {
+    public:
+    explicit ChangeDetector(int threshold = 30, double fraction = 0.005);
+
+    /**
+     * Compare image with the reference. Always true when there is no
+     * reference yet or the image size or type changed.
+     */
+    bool Changed(const cv::Mat& image);
+
+    /**
+     * Make the image last passed to Changed() the reference.
+     */
+    void Accept();
+
+    private:
+    static const int kColumns = 64;
+    static const int kRows = 48;
+
+    int m_threshold;
+    double m_fraction;
+    std::vector<uint8_t> m_samples;
+    std::vector<uint8_t> m_reference;
+    cv::Size m_size;
+    int m_type = -1;
+    bool m_haveReference = false;
+    bool m_sampled = false;
+};
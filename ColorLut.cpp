@@ -0,0 +1,120 @@
+#include "ColorLut.h"
+
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+void ColorLut::SetRanges(const std::vector<ColorRange>& ranges) {
+    SetClasses({ranges});
+}
+
+void ColorLut::SetClasses(const std::vector<std::vector<ColorRange>>& classes) {
+    CV_Assert(classes.size() <= kMaxClasses);
+    if (m_built && classes == m_classes) return;
+    m_classes = classes;
+    Build();
+}
+
+void ColorLut::Build() {
+    // One pixel per cell, a row for every blue and green, a column for every
+    // red, so the pixel index is the table index
+    const int n = 1 << kBits;
+    const int offset = (1 << kShift) / 2;
+    cv::Mat colors(n * n, n, CV_8UC3);
+    for (int b = 0; b < n; ++b) {
+        for (int g = 0; g < n; ++g) {
+            cv::Vec3b* row = colors.ptr<cv::Vec3b>(b * n + g);
+            for (int r = 0; r < n; ++r) {
+                row[r] = cv::Vec3b((b << kShift) + offset, (g << kShift) + offset, (r << kShift) + offset);
+            }
+        }
+    }
+
+    // Each colour space is converted to once however many ranges use it
+    cv::Mat converted[3];
+    const int codes[3] = {cv::COLOR_BGR2RGB, cv::COLOR_BGR2HSV, cv::COLOR_BGR2HLS};
+
+    m_table.assign(colors.total(), 0);
+    cv::Mat table(colors.size(), CV_8UC1, m_table.data());
+    cv::Mat matched, in;
+    for (size_t i = 0; i < m_classes.size(); ++i) {
+        if (m_classes[i].empty()) continue;
+        matched.create(colors.size(), CV_8UC1);
+        matched.setTo(cv::Scalar(1 << i));
+        for (auto& range : m_classes[i]) {
+            CV_Assert(range.space != ColorRange::kYuv);
+            cv::Mat& space = converted[range.space];
+            if (space.empty()) cv::cvtColor(colors, space, codes[range.space]);
+            cv::inRange(space, range.lower, range.upper, in);
+            cv::bitwise_and(matched, in, matched);
+        }
+        cv::bitwise_or(table, matched, table);
+    }
+    m_built = true;
+}
+
+void ColorLut::Threshold(const cv::Mat& bgr, cv::Mat& mask) const {
+    CV_Assert(bgr.type() == CV_8UC3 && m_built);
+    mask.create(bgr.size(), CV_8UC1);
+    const uint8_t* table = m_table.data();
+    for (int y = 0; y < bgr.rows; ++y) {
+        const uint8_t* p = bgr.ptr<uint8_t>(y);
+        uint8_t* out = mask.ptr<uint8_t>(y);
+        for (int x = 0; x < bgr.cols; ++x, p += 3) {
+            out[x] = table[Index(p)] & 1 ? 255 : 0;
+        }
+    }
+}
+
+void ColorLut::Classify(const cv::Mat& bgr, cv::Mat& classes) const {
+    CV_Assert(bgr.type() == CV_8UC3 && m_built);
+    classes.create(bgr.size(), CV_8UC1);
+    const uint8_t* table = m_table.data();
+    for (int y = 0; y < bgr.rows; ++y) {
+        const uint8_t* p = bgr.ptr<uint8_t>(y);
+        uint8_t* out = classes.ptr<uint8_t>(y);
+        for (int x = 0; x < bgr.cols; ++x, p += 3) {
+            out[x] = table[Index(p)];
+        }
+    }
+}
+
+void classBounds(const cv::Mat& classes, cv::Rect bounds[ColorLut::kMaxClasses],
+                 int counts[ColorLut::kMaxClasses]) {
+    CV_Assert(classes.type() == CV_8UC1);
+    const int n = ColorLut::kMaxClasses;
+    int minX[n], maxX[n], minY[n], maxY[n];
+    for (int i = 0; i < n; ++i) {
+        minX[i] = classes.cols;
+        minY[i] = classes.rows;
+        maxX[i] = maxY[i] = -1;
+        counts[i] = 0;
+    }
+
+    for (int y = 0; y < classes.rows; ++y) {
+        const uint8_t* p = classes.ptr<uint8_t>(y);
+        unsigned inRow = 0;
+        for (int x = 0; x < classes.cols; ++x) {
+            // Most pixels are in no class and cost a compare
+            unsigned c = p[x];
+            if (!c) continue;
+            inRow |= c;
+            do {
+                int i = __builtin_ctz(c);
+                c &= c - 1;
+                ++counts[i];
+                minX[i] = std::min(minX[i], x);
+                maxX[i] = std::max(maxX[i], x);
+            } while (c);
+        }
+        for (; inRow; inRow &= inRow - 1) {
+            int i = __builtin_ctz(inRow);
+            minY[i] = std::min(minY[i], y);
+            maxY[i] = y;
+        }
+    }
+
+    for (int i = 0; i < n; ++i) {
+        bounds[i] = counts[i] ? cv::Rect(minX[i], minY[i], maxX[i] - minX[i] + 1, maxY[i] - minY[i] + 1) : cv::Rect();
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * A box in one colour space, as cv::inRange would test it on the output of
+ * cv::cvtColor to that space: (R, G, B), (H, S, V) or (H, L, S), hue 0-180.
+ * kYuv is (Y, U, V) as a raw camera's YUYV frame holds it, tested on the
+ * frame itself by a ConfiguredPipeline threshold, ColorLut cannot take it.
+ */
+struct ColorRange {
+    enum Space { kRgb, kHsv, kHls, kYuv };
+
+    Space space = kRgb;
+    cv::Scalar lower;
+    cv::Scalar upper;
+
+    bool operator==(const ColorRange& other) const {
+        return space == other.space && lower == other.lower && upper == other.upper;
+    }
+    bool operator!=(const ColorRange& other) const { return !(*this == other); }
+};
+
+/**
+ * Classifies BGR pixels against up to 8 classes of colour with one table
+ * lookup per pixel, whatever colour spaces the ranges are in and however
+ * many classes there are. A pixel is in a class if it is inside every range
+ * of the class, e.g. an HLS box and an RGB box for the cargo.
+ *
+ * The table has a byte for every colour quantised to 6 bits per channel
+ * (64x64x64 bytes, 256 KB), bit i set if the colour is in class i, worked out
+ * with cv::cvtColor and cv::inRange at the centre of each cell. Colours within
+ * 4 levels of a range's edge may come out on the wrong side, which the blur
+ * in front of a threshold swamps anyway. The table is only rebuilt when the
+ * classes change.
+ */
+class ColorLut {
+    public:
+    static const int kMaxClasses = 8;
+
+    /**
+     * Match the pixels inside all of ranges, as class 0 and the only class.
+     * Cheap if they did not change.
+     */
+    void SetRanges(const std::vector<ColorRange>& ranges);
+
+    /**
+     * Class i is the pixels inside all of classes[i]. At most kMaxClasses,
+     * a class without ranges matches nothing. Cheap if they did not change.
+     */
+    void SetClasses(const std::vector<std::vector<ColorRange>>& classes);
+
+    /**
+     * mask is 255 where the pixel of bgr (CV_8UC3) is in class 0, 0 elsewhere.
+     */
+    void Threshold(const cv::Mat& bgr, cv::Mat& mask) const;
+
+    /**
+     * classes (CV_8UC1) has bit i set where the pixel of bgr (CV_8UC3) is in
+     * class i. (classes & (1 << i)) != 0 is the mask of one class.
+     */
+    void Classify(const cv::Mat& bgr, cv::Mat& classes) const;
+
+    private:
+    static const int kBits = 6;
+    static const int kShift = 8 - kBits;
+
+    static unsigned Index(const uint8_t* p) {
+        return (p[0] >> kShift) << (2 * kBits) | (p[1] >> kShift) << kBits | (p[2] >> kShift);
+    }
+
+    void Build();
+
+    std::vector<std::vector<ColorRange>> m_classes;
+    bool m_built = false;
+    // Classes of the quantised colour at (b << 2 * kBits | g << kBits | r)
+    std::vector<uint8_t> m_table;
+};
+
+/**
+ * Bounding box and pixel count of every class in an image from
+ * ColorLut::Classify(), in a single pass whatever the number of classes.
+ * Classes without pixels get an empty box.
+ */
+void classBounds(const cv::Mat& classes, cv::Rect bounds[ColorLut::kMaxClasses],
+                 int counts[ColorLut::kMaxClasses]);
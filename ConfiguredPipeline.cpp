@@ -0,0 +1,278 @@
+#include "ConfiguredPipeline.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "BoxDownscale.h"
+#include "HsvThreshold.h"
+#include "YuyvKernels.h"
+
+class PipelineOperator {
+    public:
+    virtual ~PipelineOperator() = default;
+
+    virtual void Run(ConfiguredPipeline::State& state) = 0;
+
+    /**
+     * Take the parameters of a step of the same kind and size.
+     */
+    virtual void Update(const PipelineStep& step) = 0;
+};
+
+namespace {
+
+    class Resize : public PipelineOperator {
+        public:
+        explicit Resize(const PipelineStep& step) : m_size(step.size) {}
+
+        void Run(ConfiguredPipeline::State& state) override {
+            // Already done if the consumer took the frame at this size
+            if (state.image.empty() || state.image.size() == m_size) return;
+            if (m_size.width <= state.image.cols && m_size.height <= state.image.rows) {
+                areaDownscale(state.image, m_output, m_size);
+            } else {
+                cv::resize(state.image, m_output, m_size, 0, 0, cv::INTER_LINEAR);
+            }
+            state.image = m_output;
+        }
+
+        void Update(const PipelineStep&) override {}
+
+        private:
+        cv::Size m_size;
+        cv::Mat m_output;
+    };
+
+    class Blur : public PipelineOperator {
+        public:
+        explicit Blur(const PipelineStep& step) { Update(step); }
+
+        void Run(ConfiguredPipeline::State& state) override {
+            int radius = static_cast<int>(m_radius + 0.5);
+            if (state.image.empty() || radius <= 0) return;
+            switch (m_type) {
+                case PipelineStep::kBox:
+                    cv::blur(state.image, m_output, cv::Size(2 * radius + 1, 2 * radius + 1));
+                    break;
+                case PipelineStep::kGaussian: {
+                    // As GRIP does it
+                    int size = 6 * radius + 1;
+                    cv::GaussianBlur(state.image, m_output, cv::Size(size, size), radius);
+                    break;
+                }
+                case PipelineStep::kMedian:
+                    cv::medianBlur(state.image, m_output, 2 * radius + 1);
+                    break;
+            }
+            state.image = m_output;
+        }
+
+        void Update(const PipelineStep& step) override {
+            m_type = step.blurType;
+            m_radius = step.radius;
+        }
+
+        private:
+        PipelineStep::BlurType m_type;
+        double m_radius;
+        cv::Mat m_output;
+    };
+
+    class Threshold : public PipelineOperator {
+        public:
+        explicit Threshold(const PipelineStep& step) { Update(step); }
+
+        void Run(ConfiguredPipeline::State& state) override {
+            if (state.image.empty()) return;
+            if (m_range.space == ColorRange::kYuv) {
+                // Only the YUYV frame of a raw camera has YUV to test
+                if (state.image.type() != CV_8UC2) return;
+                yuyvInRange(state.image, m_range.lower, m_range.upper, m_output);
+            } else if (m_useLut) {
+                m_lut.Threshold(state.image, m_output);
+            } else if (m_range.space == ColorRange::kHsv) {
+                double hue[2] = {m_range.lower[0], m_range.upper[0]};
+                double sat[2] = {m_range.lower[1], m_range.upper[1]};
+                double val[2] = {m_range.lower[2], m_range.upper[2]};
+                fusedHsvThreshold(state.image, hue, sat, val, m_output);
+            } else if (m_range.space == ColorRange::kRgb) {
+                // The frame is BGR, so swap the bounds rather than the image
+                cv::inRange(state.image, cv::Scalar(m_range.lower[2], m_range.lower[1], m_range.lower[0]),
+                            cv::Scalar(m_range.upper[2], m_range.upper[1], m_range.upper[0]), m_output);
+            } else {
+                cv::cvtColor(state.image, m_converted, cv::COLOR_BGR2HLS);
+                cv::inRange(m_converted, m_range.lower, m_range.upper, m_output);
+            }
+            state.mask = m_output;
+        }
+
+        void Update(const PipelineStep& step) override {
+            m_range = step.range;
+            m_useLut = step.lut;
+            // Only rebuilt if the range changed
+            if (m_useLut) m_lut.SetRanges(std::vector<ColorRange>{m_range});
+        }
+
+        private:
+        ColorRange m_range;
+        bool m_useLut = false;
+        ColorLut m_lut;
+        cv::Mat m_converted;
+        cv::Mat m_output;
+    };
+
+    class Mask : public PipelineOperator {
+        public:
+        explicit Mask(const PipelineStep&) {}
+
+        void Run(ConfiguredPipeline::State& state) override {
+            if (state.image.empty() || state.mask.size() != state.image.size()) return;
+            m_output.create(state.image.size(), state.image.type());
+            m_output.setTo(cv::Scalar::all(0));
+            state.image.copyTo(m_output, state.mask);
+            state.image = m_output;
+        }
+
+        void Update(const PipelineStep&) override {}
+
+        private:
+        cv::Mat m_output;
+    };
+
+    class Blobs : public PipelineOperator {
+        public:
+        explicit Blobs(const PipelineStep& step) : m_filter(step.filter) {}
+
+        void Run(ConfiguredPipeline::State& state) override {
+            state.blobSpace = state.mask.size();
+            m_finder.Find(state.mask, m_filter, state.blobs);
+        }
+
+        void Update(const PipelineStep& step) override { m_filter = step.filter; }
+
+        private:
+        BlobFilter m_filter;
+        BlobFinder m_finder;
+    };
+
+    class Targets : public PipelineOperator {
+        public:
+        explicit Targets(const PipelineStep& step) { Update(step); }
+
+        void Run(ConfiguredPipeline::State& state) override {
+            if (state.image.empty()) return;
+            m_classifier.Process(state.image);
+            cv::compare(m_classifier.GetClasses(), cv::Scalar(0), m_output, cv::CMP_NE);
+            state.mask = m_output;
+            state.blobSpace = m_output.size();
+            // The names were put in the state with the chain
+            for (size_t i = 0; i < state.targets.size() && i < m_classifier.GetTargetCount(); ++i) {
+                state.targets[i].blobs = m_classifier.GetResult(i).blobs;
+            }
+        }
+
+        void Update(const PipelineStep& step) override { m_classifier.SetTargets(step.targets); }
+
+        private:
+        TargetClassifier m_classifier;
+        cv::Mat m_output;
+    };
+
+    std::unique_ptr<PipelineOperator> Build(const PipelineStep& step) {
+        switch (step.kind) {
+            case PipelineStep::kResize:
+                return std::unique_ptr<PipelineOperator>(new Resize(step));
+            case PipelineStep::kBlur:
+                return std::unique_ptr<PipelineOperator>(new Blur(step));
+            case PipelineStep::kThreshold:
+                return std::unique_ptr<PipelineOperator>(new Threshold(step));
+            case PipelineStep::kMask:
+                return std::unique_ptr<PipelineOperator>(new Mask(step));
+            case PipelineStep::kBlobs:
+                return std::unique_ptr<PipelineOperator>(new Blobs(step));
+            case PipelineStep::kTargets:
+                return std::unique_ptr<PipelineOperator>(new Targets(step));
+        }
+        return nullptr;
+    }
+}  // namespace
+
+ConfiguredPipeline::ConfiguredPipeline(const PipelineConfig& config) : m_config(config) {
+    for (auto& step : m_config.steps) m_operators.push_back(Build(step));
+    NameTargets();
+}
+
+ConfiguredPipeline::~ConfiguredPipeline() = default;
+
+bool ConfiguredPipeline::Update(const PipelineConfig& config) {
+    if (config.steps.size() != m_config.steps.size()) return false;
+    for (size_t i = 0; i < config.steps.size(); ++i) {
+        const PipelineStep& step = config.steps[i];
+        if (step.kind != m_config.steps[i].kind) return false;
+        if (step.kind == PipelineStep::kResize && step.size != m_config.steps[i].size) return false;
+        // The consumer was told whether to hand over YUYV frames
+        if (step.kind == PipelineStep::kThreshold &&
+            (step.range.space == ColorRange::kYuv) != (m_config.steps[i].range.space == ColorRange::kYuv)) {
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < config.steps.size(); ++i) m_operators[i]->Update(config.steps[i]);
+    m_config = config;
+    NameTargets();
+    return true;
+}
+
+void ConfiguredPipeline::NameTargets() {
+    m_state.targets.clear();
+    for (auto& step : m_config.steps) {
+        if (step.kind != PipelineStep::kTargets) continue;
+        for (auto& target : step.targets) {
+            State::Target t;
+            t.name = target.name;
+            m_state.targets.push_back(t);
+        }
+    }
+}
+
+bool ConfiguredPipeline::TakesYuyv() const {
+    return !m_config.steps.empty() && m_config.steps[0].kind == PipelineStep::kThreshold &&
+           m_config.steps[0].range.space == ColorRange::kYuv;
+}
+
+cv::Size ConfiguredPipeline::FirstResize() const {
+    if (m_config.steps.empty() || m_config.steps[0].kind != PipelineStep::kResize) return cv::Size();
+    return m_config.steps[0].size;
+}
+
+void ConfiguredPipeline::Process(cv::Mat& mat) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Only the header, the operators never write into the frame
+    m_state.image = mat;
+    m_state.mask = cv::Mat();
+    for (auto& op : m_operators) op->Run(m_state);
+}
+
+namespace {
+
+    void Scale(const std::vector<cv::Rect>& blobs, cv::Size from, cv::Size to, std::vector<cv::Rect>& scaled) {
+        scaled.clear();
+        if (from.area() == 0) return;
+        double sx = to.width / static_cast<double>(from.width);
+        double sy = to.height / static_cast<double>(from.height);
+        for (auto& blob : blobs) {
+            scaled.emplace_back(cvRound(blob.x * sx), cvRound(blob.y * sy), cvRound(blob.width * sx),
+                                cvRound(blob.height * sy));
+        }
+    }
+}  // namespace
+
+void ConfiguredPipeline::GetResults(cv::Size frameSize, PipelineResults& results) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Scale(m_state.blobs, m_state.blobSpace, frameSize, results.blobs);
+    results.targets.resize(m_state.targets.size());
+    for (size_t i = 0; i < m_state.targets.size(); ++i) {
+        results.targets[i].name = m_state.targets[i].name;
+        Scale(m_state.targets[i].blobs, m_state.blobSpace, frameSize, results.targets[i].blobs);
+    }
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <vision/VisionPipeline.h>
+
+#include "BlobFilter.h"
+#include "ColorLut.h"
+#include "TargetClassifier.h"
+
+/**
+ * One step of a pipeline from the config file. Only the fields of its kind
+ * are used.
+ */
+struct PipelineStep {
+    enum Kind {
+        // Scale the image to size
+        kResize,
+        // Soften the image, radius in pixels
+        kBlur,
+        // The mask of the pixels inside range
+        kThreshold,
+        // Black out the image outside the mask
+        kMask,
+        // Bounding boxes of the blobs in the mask that pass the filter
+        kBlobs,
+        // The blobs of several targets from one classifying pass, and the
+        // mask of the pixels that matched any of them
+        kTargets
+    };
+    enum BlurType { kBox, kGaussian, kMedian };
+
+    Kind kind = kResize;
+
+    cv::Size size;
+
+    BlurType blurType = kBox;
+    double radius = 0;
+
+    ColorRange range;
+    // Threshold with a ColorLut instead of converting the image
+    bool lut = false;
+
+    BlobFilter filter;
+
+    // At most ColorLut::kMaxClasses
+    std::vector<TargetClass> targets;
+
+    bool operator==(const PipelineStep& other) const {
+        return kind == other.kind && size == other.size && blurType == other.blurType &&
+               radius == other.radius && range == other.range && lut == other.lut && filter == other.filter &&
+               targets == other.targets;
+    }
+    bool operator!=(const PipelineStep& other) const { return !(*this == other); }
+};
+
+/**
+ * A vision pipeline described in the config file, run on the frames of one
+ * camera.
+ */
+struct PipelineConfig {
+    std::string name;
+    std::string camera;
+    // Run on every nth frame
+    int divider = 1;
+    std::vector<PipelineStep> steps;
+
+    bool operator==(const PipelineConfig& other) const {
+        return name == other.name && camera == other.camera && divider == other.divider &&
+               steps == other.steps;
+    }
+    bool operator!=(const PipelineConfig& other) const { return !(*this == other); }
+};
+
+/**
+ * The blobs a ConfiguredPipeline found in a frame.
+ */
+struct PipelineResults {
+    struct Target {
+        std::string name;
+        std::vector<cv::Rect> blobs;
+    };
+
+    // Of the blobs step
+    std::vector<cv::Rect> blobs;
+    // One per target of the targets step, none without one
+    std::vector<Target> targets;
+};
+
+// One step of a ConfiguredPipeline once built
+class PipelineOperator;
+
+/**
+ * A vision pipeline built from a list of steps instead of generated by GRIP,
+ * so thresholds can be tuned in the config file without a rebuild.
+ *
+ * The steps are turned into a chain of operators once, each keeping the
+ * buffer it writes into, so after the first frame nothing is allocated. The
+ * steps work on an image, starting with the BGR frame, and a mask: resize and
+ * blur replace the image, threshold replaces the mask, mask blacks out the
+ * image outside the mask, and blobs finds the targets in the mask. HSV
+ * thresholds use fusedHsvThreshold(), RGB thresholds test the BGR image
+ * directly and HLS thresholds convert it first. A threshold with lut set
+ * looks the pixels up in a ColorLut instead, one pass whatever the space but
+ * only exact to 4 levels. A YUV threshold, only as the first step
+ * and only followed by blobs, tests a raw camera's YUYV frame with
+ * yuyvInRange(), so the frame is never converted to BGR or HSV.
+ *
+ * A targets step stands in for a threshold and blobs step per target: its
+ * targets share one TargetClassifier pass over the image, each with its own
+ * blob filter, and its mask is every pixel that matched any of them.
+ *
+ * Update() changes the parameters of the running chain, e.g. thresholds and
+ * blob filters, without reallocating anything but the lookup table of a
+ * targets step whose thresholds changed. Only different steps, resize
+ * sizes or a threshold changing to or from YUV need a new pipeline.
+ *
+ * Use with a PipelineConsumer, setting its input size to FirstResize() so the
+ * first resize comes from the camera's frame pyramid, and its native YUYV to
+ * TakesYuyv().
+ */
+class ConfiguredPipeline : public frc::VisionPipeline {
+    public:
+    explicit ConfiguredPipeline(const PipelineConfig& config);
+    ~ConfiguredPipeline() override;
+
+    /**
+     * Take the parameters of config if its steps are the same kinds and
+     * sizes. Returns false, changing nothing, if it needs a new pipeline.
+     * Safe while the pipeline is running.
+     */
+    bool Update(const PipelineConfig& config);
+
+    const PipelineConfig& GetConfig() const { return m_config; }
+
+    /**
+     * Size of the first step if it is a resize, otherwise empty.
+     */
+    cv::Size FirstResize() const;
+
+    /**
+     * The first step is a YUV threshold, which works on a raw camera's YUYV
+     * frame as it is, so the consumer must not convert it, see
+     * PipelineConsumer::SetNativeYuyv().
+     */
+    bool TakesYuyv() const;
+
+    void Process(cv::Mat& mat) override;
+
+    /**
+     * What the last frame found, blobs largest first and scaled from the
+     * mask they were found in to frameSize, e.g. camera pixels. Taken under
+     * the same lock as Process() and Update(), so a config reload cannot
+     * change the targets while they are read. The vectors of results are
+     * reused.
+     */
+    void GetResults(cv::Size frameSize, PipelineResults& results) const;
+
+    /**
+     * Image and mask after the last step, e.g. to show on a stream.
+     */
+    const cv::Mat& GetImage() const { return m_state.image; }
+    const cv::Mat& GetMask() const { return m_state.mask; }
+
+    /**
+     * What the operators work on, passed down the chain.
+     */
+    struct State {
+        cv::Mat image;
+        cv::Mat mask;
+        std::vector<cv::Rect> blobs;
+        // The targets step's results, blobs in blobSpace as well
+        struct Target {
+            std::string name;
+            std::vector<cv::Rect> blobs;
+        };
+        std::vector<Target> targets;
+        cv::Size blobSpace;
+    };
+
+    private:
+    // One entry in m_state.targets per target of the targets step
+    void NameTargets();
+
+    PipelineConfig m_config;
+    std::vector<std::unique_ptr<PipelineOperator>> m_operators;
+    // Held while running the chain, updating it and reading its results
+    mutable std::mutex m_mutex;
+    State m_state;
+};
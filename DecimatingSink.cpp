@@ -0,0 +1,44 @@
+#include "DecimatingSink.h"
+
+#include <chrono>
+#include <thread>
+
+#include <wpi/timestamp.h>
+
+#include "cameraserver/CameraServer.h"
+
+DecimatingSink::DecimatingSink(const cs::VideoSource& camera, int divider)
+    : m_camera(camera),
+      m_sink(frc::CameraServer::GetInstance()->GetVideo(camera)) {
+    SetDivider(divider);
+    int fps = m_camera.GetVideoMode().fps;
+    m_period = 1000000 / (fps > 0 ? fps : 30);
+}
+
+uint64_t DecimatingSink::GrabFrame(cv::Mat& image, double timeout) {
+    if (m_divider > 1 && m_lastFrameTime != 0) {
+        // Sleep through the frames we do not want. Wake half a frame before
+        // the nth frame is due so the grab below picks up exactly that one.
+        uint64_t wake = m_lastFrameTime + m_period * (2 * m_divider - 1) / 2;
+        uint64_t now = wpi::Now();
+        if (wake > now)
+            std::this_thread::sleep_for(std::chrono::microseconds(wake - now));
+    }
+
+    // The frame before the one we grab was never decoded, but its time still
+    // tells us how fast the camera is really running
+    uint64_t before = m_camera.GetLastFrameTime();
+    uint64_t time = m_sink.GrabFrame(image, timeout);
+    if (time == 0) {
+        m_lastFrameTime = 0;
+        return 0;
+    }
+
+    if (before != 0 && time > before) {
+        uint64_t period = time - before;
+        // Ignore gaps from camera stalls, they are not the frame rate
+        if (period < 8 * m_period) m_period = (7 * m_period + period) / 8;
+    }
+    m_lastFrameTime = time;
+    return time;
+}
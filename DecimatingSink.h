@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <cscore.h>
+#include <opencv2/core/core.hpp>
+
+/**
+ * A CvSink that only hands out every nth camera frame.
+ *
+ * cscore only decodes a frame when a sink grabs it, so instead of grabbing every
+ * frame and throwing most of them away this sink sleeps through the frames it
+ * does not want and only asks for the one it does. The JPEG decode cost then
+ * scales with the output rate rather than the camera rate.
+ *
+ * The frame period is taken from the camera video mode at first and then
+ * tracked from the camera's last frame time, which is available without
+ * decoding anything.
+ */
+class DecimatingSink {
+    public:
+    DecimatingSink(const cs::VideoSource& camera, int divider);
+
+    /**
+     * Wait for the next wanted frame and decode it into image.
+     *
+     * @return Frame time, or 0 on error (call GetError() for details)
+     */
+    uint64_t GrabFrame(cv::Mat& image, double timeout = 0.225);
+
+    std::string GetError() const { return m_sink.GetError(); }
+    void SetEnabled(bool enabled) { m_sink.SetEnabled(enabled); }
+
+    void SetDivider(int divider) { m_divider = divider < 1 ? 1 : divider; }
+    int GetDivider() const { return m_divider; }
+
+    /**
+     * Estimated time between camera frames in microseconds.
+     */
+    uint64_t GetFramePeriod() const { return m_period; }
+
+    bool IsConnected() const { return m_camera.IsConnected(); }
+
+    private:
+    cs::VideoSource m_camera;
+    cs::CvSink m_sink;
+    int m_divider;
+    uint64_t m_period;
+    uint64_t m_lastFrameTime = 0;
+};
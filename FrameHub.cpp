@@ -0,0 +1,364 @@
+#include "FrameHub.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+std::shared_ptr<Frame> FramePool::Acquire() {
+    for (auto& frame : m_frames) {
+        if (frame.use_count() == 1) {
+            // Pairs with the release done by the last consumer dropping the
+            // frame, so its reads of the image are finished before we reuse it
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return frame;
+        }
+    }
+    m_frames.emplace_back(std::make_shared<Frame>());
+    return m_frames.back();
+}
+
+/**
+ * Processing thread of one consumer. The capture thread publishes into the
+ * mailbox and this thread takes the newest frame whenever it is ready.
+ */
+class FrameHub::ConsumerThread {
+    public:
+    ConsumerThread(const std::shared_ptr<FrameConsumer>& consumer, const std::string& name,
+                   const std::function<void()>& init, const SchedulePolicy& policy)
+        : m_consumer(consumer), m_name(name), m_init(init), m_policy(policy) {
+        m_thread = std::thread(&ConsumerThread::Run, this);
+    }
+
+    ~ConsumerThread() {
+        m_running = false;
+        m_mailbox.Wake();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    // Called from the capture thread, never blocks
+    void Publish(const FramePtr& frame) { m_mailbox.Publish(frame); }
+
+    // Called from the capture thread, only on the error path
+    void Error(const std::string& message) {
+        {
+            std::lock_guard<std::mutex> lock(m_errorMutex);
+            m_error = message;
+        }
+        m_hasError = true;
+        m_mailbox.Wake();
+    }
+
+    Stats GetStats() const {
+        Stats stats;
+        stats.published = m_mailbox.GetPublished();
+        stats.skipped = m_mailbox.GetOverwritten();
+        return stats;
+    }
+
+    const std::shared_ptr<FrameConsumer>& GetConsumer() const { return m_consumer; }
+
+    // Only used by the capture thread: deliver every nth hub frame, if the
+    // consumer is active
+    int step = 1;
+    bool active = false;
+
+    private:
+    void Run() {
+        if (m_init) m_init();
+        bool vision = m_consumer->IsVision();
+        Scheduler& scheduler = Scheduler::GetInstance();
+        scheduler.ApplyToCurrentThread(m_name, vision ? m_policy.vision : m_policy.stream);
+
+        FramePtr frame;
+        while (m_running) {
+            if (m_mailbox.WaitTake(frame, std::chrono::milliseconds(100))) {
+                m_consumer->OnFrame(frame);
+                if (vision) {
+                    double latency = (wpi::Now() - frame->time) * 1.0e-6;
+                    scheduler.ReportVisionLatency(m_name, latency, m_policy.vision.deadline);
+                }
+                // Do not hold on to the buffer while waiting for the next one
+                frame.reset();
+            }
+            if (m_hasError.exchange(false)) {
+                std::string message;
+                {
+                    std::lock_guard<std::mutex> lock(m_errorMutex);
+                    message.swap(m_error);
+                }
+                m_consumer->OnError(message);
+            }
+        }
+    }
+
+    std::shared_ptr<FrameConsumer> m_consumer;
+    std::string m_name;
+    std::function<void()> m_init;
+    SchedulePolicy m_policy;
+    LatestFrameMailbox<FramePtr> m_mailbox;
+
+    std::mutex m_errorMutex;
+    std::string m_error;
+    std::atomic_bool m_hasError{false};
+
+    std::atomic_bool m_running{true};
+    std::thread m_thread;
+};
+
+FrameHub::FrameHub(const cs::VideoSource& camera, const std::string& name, bool decimate)
+    : m_camera(camera), m_name(name), m_decimate(decimate),
+      m_latency(std::make_shared<LatencyTracker>(name)), m_health(name) {}
+
+FrameHub::~FrameHub() {
+    Stop();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_consumers.clear();
+}
+
+void FrameHub::AddConsumer(const std::shared_ptr<FrameConsumer>& consumer) {
+    consumer->SetLatencyTracker(m_latency);
+    auto thread = std::make_shared<ConsumerThread>(consumer, m_name, m_threadInit, m_policy);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_consumers.push_back(thread);
+    m_consumersChanged = true;
+}
+
+void FrameHub::RemoveConsumer(const std::shared_ptr<FrameConsumer>& consumer) {
+    std::shared_ptr<ConsumerThread> removed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_consumers.begin(), m_consumers.end(),
+            [&](const std::shared_ptr<ConsumerThread>& t) { return t->GetConsumer() == consumer; });
+        if (it == m_consumers.end()) return;
+        removed = *it;
+        m_consumers.erase(it);
+        m_consumersChanged = true;
+    }
+    // The capture thread may still hold the last reference, in which case the
+    // consumer thread is joined there once it has picked up the change
+}
+
+FrameHub::Stats FrameHub::GetStats(const std::shared_ptr<FrameConsumer>& consumer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& thread : m_consumers) {
+        if (thread->GetConsumer() == consumer) return thread->GetStats();
+    }
+    return Stats();
+}
+
+void FrameHub::PublishStats() {
+    std::vector<std::pair<std::string, Stats>> stats;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_consumers.size(); ++i) {
+            std::string name = m_consumers[i]->GetConsumer()->GetName();
+            if (name.empty()) name = "consumer " + std::to_string(i);
+            stats.emplace_back(name, m_consumers[i]->GetStats());
+        }
+    }
+    auto table = nt::NetworkTableInstance::GetDefault().GetTable("CameraDelivery")->GetSubTable(m_name);
+    for (auto& consumer : stats) {
+        auto sub = table->GetSubTable(consumer.first);
+        sub->GetEntry("published").SetDouble(consumer.second.published);
+        sub->GetEntry("skipped").SetDouble(consumer.second.skipped);
+    }
+}
+
+void FrameHub::ConsumersChanged() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_consumersChanged = true;
+}
+
+void FrameHub::SetDecimate(bool decimate) {
+    m_decimate = decimate;
+    ConsumersChanged();
+}
+
+void FrameHub::Start() {
+    if (m_running.exchange(true)) return;
+    CS_Source handle = m_camera.GetHandle();
+    m_listener = cs::VideoListener([this, handle](const cs::VideoEvent& event) {
+        std::lock_guard<std::mutex> lock(m_connectMutex);
+        if (event.kind == cs::VideoEvent::kSourceConnected) {
+            if (event.sourceHandle != handle) return;
+            m_connectEvent = true;
+        } else {
+            // Any sink coming or going may mean a consumer became active
+            m_demandEvent = true;
+        }
+        m_connectCv.notify_one();
+    }, cs::VideoEvent::kSourceConnected | cs::VideoEvent::kSinkCreated | cs::VideoEvent::kSinkEnabled |
+       cs::VideoEvent::kSinkDisabled | cs::VideoEvent::kSinkSourceChanged, false);
+    m_thread = std::thread(&FrameHub::Run, this);
+}
+
+void FrameHub::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_connectMutex);
+        m_running = false;
+        m_connectCv.notify_one();
+    }
+    if (m_thread.joinable()) m_thread.join();
+    m_listener = cs::VideoListener();
+}
+
+void FrameHub::Restart() {
+    bool running = m_running;
+    Stop();
+
+    // Consumer threads pick up the thread init and policy when they start
+    std::vector<std::shared_ptr<ConsumerThread>> old;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        old.swap(m_consumers);
+        for (auto& thread : old)
+            m_consumers.push_back(std::make_shared<ConsumerThread>(thread->GetConsumer(), m_name, m_threadInit, m_policy));
+        m_consumersChanged = true;
+    }
+    old.clear();
+
+    if (running) Start();
+}
+
+void FrameHub::Run() {
+    if (m_threadInit) m_threadInit();
+    // Capture is the first step of every vision result
+    Scheduler::GetInstance().ApplyToCurrentThread(m_name, m_policy.vision);
+
+    if (m_rawPath.empty()) {
+        DecimatingSink sink(m_camera, 1);
+        Capture(sink);
+    } else {
+        YuyvCapture sink(m_rawPath, m_rawMode, 1);
+        Capture(sink);
+    }
+}
+
+template <typename Sink>
+void FrameHub::Capture(Sink& sink) {
+    FramePool pool;
+    std::vector<std::shared_ptr<ConsumerThread>> entries;
+    uint64_t sequence = 0;
+    // Pyramid sizes the active consumers want
+    std::vector<cv::Size> sizes;
+    bool first = true;
+    bool suspended = false;
+    int active = 0;
+
+    while (m_running) {
+        bool changed = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_consumersChanged || first) {
+                entries = m_consumers;
+                m_consumersChanged = false;
+                first = false;
+                changed = true;
+            }
+        }
+
+        // Only grab and decode for consumers somebody is actually watching
+        for (auto& thread : entries) {
+            bool wanted = thread->GetConsumer()->IsActive();
+            if (wanted != thread->active) {
+                thread->active = wanted;
+                changed = true;
+            }
+        }
+
+        if (changed) {
+            // The sink runs at the greatest common divider of the active
+            // consumers, so each of them takes exactly every nth of those
+            // frames: dividers 2 and 3 run the sink at every frame, not /2
+            int divider = 0;
+            active = 0;
+            for (auto& thread : entries) {
+                if (!thread->active) continue;
+                int d = std::max(1, thread->GetConsumer()->GetDivider());
+                while (d != 0) {
+                    int rest = divider % d;
+                    divider = d;
+                    d = rest;
+                }
+                ++active;
+            }
+            if (!m_decimate || divider == 0) divider = 1;
+            sink.SetDivider(divider);
+            for (auto& thread : entries)
+                thread->step = std::max(1, thread->GetConsumer()->GetDivider() / divider);
+
+            sizes.clear();
+            for (auto& thread : entries) {
+                cv::Size size = thread->GetConsumer()->GetInputSize();
+                if (thread->active && size.area() > 0 && std::find(sizes.begin(), sizes.end(), size) == sizes.end())
+                    sizes.push_back(size);
+            }
+        }
+
+        if (active == 0) {
+            if (!suspended) {
+                wpi::outs() << "camera '" << m_name << "': nobody watching, suspending capture\n";
+                // Lets cscore stop streaming from the camera if nothing else wants it
+                sink.SetEnabled(false);
+                suspended = true;
+            }
+            // Look again after a frame period, or straight away if a sink
+            // changed, so a new viewer gets frames within a frame
+            std::unique_lock<std::mutex> lock(m_connectMutex);
+            m_connectCv.wait_for(lock, std::chrono::microseconds(sink.GetFramePeriod()),
+                [this] { return m_demandEvent || !m_running; });
+            m_demandEvent = false;
+            continue;
+        }
+        if (suspended) {
+            wpi::outs() << "camera '" << m_name << "': resuming capture\n";
+            sink.SetEnabled(true);
+            suspended = false;
+        }
+
+        if (m_health.GetState() == CameraHealth::kDisconnected) {
+            // Do not even try to grab until the camera is back or the back
+            // off has run out
+            std::unique_lock<std::mutex> lock(m_connectMutex);
+            m_connectCv.wait_for(lock, std::chrono::microseconds(m_health.GetBackoff()),
+                [this] { return m_connectEvent || !m_running; });
+            m_connectEvent = false;
+            if (!m_running) break;
+            m_health.Reconnecting();
+        }
+
+        // Tell the sink to grab a frame from the camera. If the camera health
+        // changed because of an error tell every consumer about it.
+        std::shared_ptr<Frame> frame = pool.Acquire();
+        frame->time = sink.GrabFrame(frame->image);
+        if (frame->time == 0) {
+            if (m_health.FrameFailed(sink.IsConnected())) {
+                if (m_health.GetState() == CameraHealth::kDisconnected) {
+                    // A connect from before the camera went away, e.g. the
+                    // one at startup, must not cut the back off short
+                    std::lock_guard<std::mutex> lock(m_connectMutex);
+                    m_connectEvent = false;
+                }
+                std::string error = sink.GetError();
+                for (auto& thread : entries) thread->Error(error);
+            }
+            continue;
+        }
+        m_health.FrameGrabbed();
+        frame->sequence = sequence++;
+        frame->pyramid.Reset(sizes);
+
+        FramePtr shared = frame;
+        frame.reset();
+        for (auto& thread : entries) {
+            if (thread->active && shared->sequence % thread->step == 0) thread->Publish(shared);
+        }
+    }
+
+    sink.SetEnabled(false);
+}
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cscore.h>
+#include <opencv2/core/core.hpp>
+
+#include "CameraHealth.h"
+#include "DecimatingSink.h"
+#include "FramePyramid.h"
+#include "LatencyTracker.h"
+#include "LatestFrameMailbox.h"
+#include "Scheduler.h"
+#include "YuyvCapture.h"
+
+/**
+ * A decoded camera frame. Frames are shared between every consumer of a
+ * camera so the image must be treated as read only.
+ */
+struct Frame {
+    // BGR, or YUYV (CV_8UC2) from a camera set up with SetRawDevice()
+    cv::Mat image;
+    // Capture time from CvSink::GrabFrame, in wpi::Now() microseconds
+    uint64_t time = 0;
+    // Counts frames handed out by the hub
+    uint64_t sequence = 0;
+    // Scaled copies of image, built as consumers ask for them
+    mutable FramePyramid pyramid;
+
+    /**
+     * The image at size, BGR, shared with every other consumer asking for the
+     * same size. The image itself for an empty size.
+     */
+    cv::Mat Scaled(cv::Size size) const { return pyramid.Get(image, size); }
+};
+
+using FramePtr = std::shared_ptr<const Frame>;
+
+/**
+ * Something that wants the frames of a camera: a dashboard stream, a vision
+ * pipeline, a recorder. Every consumer gets a processing thread of its own and
+ * should keep any scratch Mats it needs as members so they get reused.
+ */
+class FrameConsumer {
+    public:
+    virtual ~FrameConsumer() = default;
+
+    /**
+     * Called with every nth frame, n being GetDivider().
+     */
+    virtual void OnFrame(const FramePtr& frame) = 0;
+
+    /**
+     * Called when the camera failed to deliver a frame.
+     */
+    virtual void OnError(const std::string&) {}
+
+    /**
+     * Only every nth camera frame is wanted by this consumer.
+     */
+    virtual int GetDivider() const { return 1; }
+
+    /**
+     * Vision consumers are scheduled ahead of the others and have their
+     * latency checked against the camera's vision deadline.
+     */
+    virtual bool IsVision() const { return false; }
+
+    /**
+     * Size the consumer will ask Frame::Scaled() for, so the hub can have the
+     * frame pyramid include it. Empty if it works on the full frame. Call
+     * FrameHub::ConsumersChanged() when it changes.
+     */
+    virtual cv::Size GetInputSize() const { return cv::Size(); }
+
+    /**
+     * Whether the consumer wants frames right now. The hub stops grabbing and
+     * decoding when no consumer is active.
+     */
+    virtual bool IsActive() const { return true; }
+
+    /**
+     * What the hub publishes the consumer's delivery counters under, e.g. the
+     * stream or pipeline name. Consumers without one are numbered.
+     */
+    virtual std::string GetName() const { return std::string(); }
+
+    /**
+     * Set by the hub when the consumer is added so it can record how long
+     * frames took to get through it.
+     */
+    void SetLatencyTracker(const std::shared_ptr<LatencyTracker>& tracker) { m_latency = tracker; }
+
+    protected:
+    std::shared_ptr<LatencyTracker> m_latency;
+};
+
+/**
+ * Fixed set of frame buffers that get handed out again once nobody holds them
+ * any more, so the hub does not allocate a new image for every frame.
+ */
+class FramePool {
+    public:
+    /**
+     * Get a frame nobody else is holding, or a new one if all are in use.
+     */
+    std::shared_ptr<Frame> Acquire();
+
+    size_t Size() const { return m_frames.size(); }
+
+    private:
+    std::vector<std::shared_ptr<Frame>> m_frames;
+};
+
+/**
+ * Grabs and decodes each camera frame once and hands the same frame to every
+ * registered consumer.
+ *
+ * The hub only asks the camera for as many frames as its most demanding
+ * consumer wants. Frames are dropped before decode as DecimatingSink does.
+ *
+ * Consumers that want the frame smaller share a FramePyramid per frame
+ * instead of each resizing the full frame themselves.
+ *
+ * Capture runs on a thread of its own and passes frames to each consumer's
+ * thread through a LatestFrameMailbox, so a slow consumer never holds up
+ * capture or the other consumers. It just skips to the newest frame.
+ *
+ * When the camera stops delivering frames the hub stops grabbing and waits for
+ * cscore to report it connected again, trying again itself with an
+ * exponential back off (see CameraHealth). Consumers only get told about
+ * errors when the camera health changes, not for every failed grab.
+ *
+ * Capture is also demand driven: frames are only grabbed and decoded while at
+ * least one consumer is active, e.g. a dashboard is actually watching a
+ * stream. The hub checks again every frame period and whenever cscore reports
+ * a sink change.
+ */
+class FrameHub {
+    public:
+    FrameHub(const cs::VideoSource& camera, const std::string& name, bool decimate = true);
+    ~FrameHub();
+
+    FrameHub(const FrameHub&) = delete;
+    FrameHub& operator=(const FrameHub&) = delete;
+
+    struct Stats {
+        // Frames handed to the consumer
+        uint64_t published = 0;
+        // Frames replaced by a newer one before the consumer got to them
+        uint64_t skipped = 0;
+    };
+
+    void AddConsumer(const std::shared_ptr<FrameConsumer>& consumer);
+    void RemoveConsumer(const std::shared_ptr<FrameConsumer>& consumer);
+
+    /**
+     * Delivery counters for a consumer, all zero if it is not registered.
+     */
+    Stats GetStats(const std::shared_ptr<FrameConsumer>& consumer);
+
+    /**
+     * Put the delivery counters of every consumer in NetworkTables under
+     * CameraDelivery/<camera>/<consumer name>. Call about once a second.
+     */
+    void PublishStats();
+
+    /**
+     * Re-read the consumers' dividers, e.g. after one was changed.
+     */
+    void ConsumersChanged();
+
+    /**
+     * Switch between dropping frames before decode and decoding every frame.
+     */
+    void SetDecimate(bool decimate);
+
+    /**
+     * Start the capture thread. Does nothing if it is already running.
+     */
+    void Start();
+
+    /**
+     * Stop the capture thread and wait for the current frame to be delivered.
+     */
+    void Stop();
+
+    /**
+     * Restart the capture thread and every consumer thread, so a changed thread
+     * init or schedule policy is applied to all of them.
+     */
+    void Restart();
+
+    const cs::VideoSource& GetCamera() const { return m_camera; }
+    const std::string& GetName() const { return m_name; }
+    LatencyTracker& GetLatencyTracker() { return *m_latency; }
+    CameraHealth& GetHealth() { return m_health; }
+
+    /**
+     * Called on the capture thread and on every consumer thread when it
+     * starts, before any frame is handled. Set it before adding consumers or
+     * call Restart() afterwards.
+     */
+    void SetThreadInit(std::function<void()> init) { m_threadInit = std::move(init); }
+
+    /**
+     * Scheduling of the hub threads. Capture and vision consumers use the
+     * vision policy, everything else the stream policy. Set it before adding
+     * consumers or call Restart() afterwards.
+     */
+    void SetSchedulePolicy(const SchedulePolicy& policy) { m_policy = policy; }
+
+    /**
+     * Capture YUYV frames straight from the V4L2 device at path with a
+     * YuyvCapture instead of through cscore, so consumers get CV_8UC2 frames.
+     * The camera passed to the constructor is not used for capture then. Call
+     * before Start().
+     */
+    void SetRawDevice(const std::string& path, const cs::VideoMode& mode) {
+        m_rawPath = path;
+        m_rawMode = mode;
+    }
+
+    private:
+    class ConsumerThread;
+
+    void Run();
+    // The capture loop, Sink being DecimatingSink or YuyvCapture
+    template <typename Sink>
+    void Capture(Sink& sink);
+
+    cs::VideoSource m_camera;
+    std::string m_name;
+    std::atomic_bool m_decimate;
+    std::function<void()> m_threadInit;
+    SchedulePolicy m_policy;
+    std::shared_ptr<LatencyTracker> m_latency;
+    std::string m_rawPath;
+    cs::VideoMode m_rawMode;
+
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<ConsumerThread>> m_consumers;
+    bool m_consumersChanged = false;
+
+    CameraHealth m_health;
+    // Woken by cscore when the camera connects or a sink changes, or by Stop()
+    cs::VideoListener m_listener;
+    std::mutex m_connectMutex;
+    std::condition_variable m_connectCv;
+    bool m_connectEvent = false;
+    bool m_demandEvent = false;
+
+    std::thread m_thread;
+    std::atomic_bool m_running{false};
+};
@@ -0,0 +1,86 @@
+#include "FramePyramid.h"
+
+#include <algorithm>
+
+#include "BoxDownscale.h"
+#include "YuyvKernels.h"
+
+namespace {
+
+    bool Larger(const cv::Size& a, const cv::Size& b) {
+        return a.area() > b.area() || (a.area() == b.area() && a.width > b.width);
+    }
+}  // namespace
+
+void FramePyramid::Reset(const std::vector<cv::Size>& sizes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // Keep the buffers of sizes that are still wanted. Sizes somebody asked for
+    // without registering them are kept while they are being used, so they do
+    // not get a new buffer every frame.
+    std::vector<Level>& levels = m_next;
+    levels.clear();
+    for (auto& size : sizes) {
+        Level level;
+        level.size = size;
+        levels.push_back(level);
+    }
+    for (auto& old : m_levels) {
+        auto it = std::find_if(levels.begin(), levels.end(), [&](const Level& l) { return l.size == old.size; });
+        if (it != levels.end()) {
+            it->image = old.image;
+        } else if (old.built) {
+            Level level;
+            level.size = old.size;
+            level.image = old.image;
+            levels.push_back(level);
+        }
+    }
+    std::sort(levels.begin(), levels.end(), [](const Level& a, const Level& b) { return Larger(a.size, b.size); });
+    m_levels.swap(levels);
+}
+
+cv::Mat FramePyramid::Get(const cv::Mat& base, cv::Size size) {
+    // A YUYV frame at full size still needs a BGR level
+    if (size.area() == 0 || (size == base.size() && base.type() == CV_8UC3)) return base;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = std::find_if(m_levels.begin(), m_levels.end(), [&](const Level& l) { return l.size == size; });
+    if (it == m_levels.end()) {
+        Level level;
+        level.size = size;
+        it = m_levels.insert(std::upper_bound(m_levels.begin(), m_levels.end(), level,
+            [](const Level& a, const Level& b) { return Larger(a.size, b.size); }), level);
+    }
+    return Build(base, it - m_levels.begin());
+}
+
+const cv::Mat& FramePyramid::Build(const cv::Mat& base, size_t index) {
+    Level& level = m_levels[index];
+    if (level.built) return level.image;
+
+    // Cascade from the nearest larger level, the frame itself for the largest
+    const cv::Mat* source = &base;
+    for (size_t i = index; i-- > 0;) {
+        const cv::Size& size = m_levels[i].size;
+        if (size.width >= level.size.width && size.height >= level.size.height &&
+            size.width <= base.cols && size.height <= base.rows) {
+            source = &Build(base, i);
+            break;
+        }
+    }
+
+    if (source->type() == CV_8UC2) {
+        int factor = source->cols / level.size.width;
+        if ((factor == 1 || factor == 2 || factor == 4) && source->cols == level.size.width * factor &&
+            source->rows == level.size.height * factor) {
+            yuyvToBgr(*source, level.image, factor);
+        } else {
+            yuyvToBgr(*source, m_converted);
+            areaDownscale(m_converted, level.image, level.size);
+        }
+    } else {
+        areaDownscale(*source, level.image, level.size);
+    }
+    level.built = true;
+    return level.image;
+}
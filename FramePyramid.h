@@ -0,0 +1,59 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Smaller copies of a frame for the consumers that want one, e.g. a
+ * 320x240 driver stream, a 160x120 thumbnail and a pipeline working at
+ * 240x180.
+ *
+ * Each size is built at most once per frame, by the first consumer to ask for
+ * it, and from the nearest larger size rather than the full frame, so the
+ * thumbnail costs a 2:1 shrink of the stream image. The hub tells the
+ * pyramid which sizes its consumers want at the start of every frame. A size
+ * nobody registered is still built on request, and kept for the next frame.
+ *
+ * Levels are always BGR. A YUYV frame is shrunk and converted in one go by
+ * yuyvToBgr() for the largest level.
+ */
+class FramePyramid {
+    public:
+    FramePyramid() = default;
+    FramePyramid(const FramePyramid&) = delete;
+    FramePyramid& operator=(const FramePyramid&) = delete;
+
+    /**
+     * Start a new frame: forget the built levels and use sizes from now on.
+     * Only called by the hub, before the frame is shared.
+     */
+    void Reset(const std::vector<cv::Size>& sizes);
+
+    /**
+     * base at size, always BGR, base itself if it already is that size and
+     * BGR. base itself for an empty size. The pixels stay valid while the
+     * frame is held.
+     */
+    cv::Mat Get(const cv::Mat& base, cv::Size size);
+
+    private:
+    struct Level {
+        cv::Size size;
+        cv::Mat image;
+        bool built = false;
+    };
+
+    // Called with m_mutex held
+    const cv::Mat& Build(const cv::Mat& base, size_t index);
+
+    std::mutex m_mutex;
+    // Largest first
+    std::vector<Level> m_levels;
+    // Reused by Reset() to build the next list of levels
+    std::vector<Level> m_next;
+    // YUYV frames converted to BGR, when the ratio does not allow shrinking
+    // and converting in one go
+    cv::Mat m_converted;
+};
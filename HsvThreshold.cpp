@@ -0,0 +1,133 @@
+#include "HsvThreshold.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HSV_THRESHOLD_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HSV_THRESHOLD_SSE2 1
+#endif
+
+HsvTables::HsvTables() {
+    sdiv[0] = hdiv[0] = 0;
+    for (int i = 1; i < 256; ++i) {
+        sdiv[i] = cv::saturate_cast<int>((255 << kShift) / (1.0 * i));
+        hdiv[i] = cv::saturate_cast<int>((180 << kShift) / (6.0 * i));
+    }
+}
+
+const HsvTables& HsvTables::Get() {
+    static const HsvTables tables;
+    return tables;
+}
+
+namespace {
+
+    const int kHsvShift = HsvTables::kShift;
+
+    // Hue and saturation test of one pixel whose value already passed
+    inline bool HueSatInRange(int b, int g, int r, const HsvTables& t, const InRangeBounds& hue, const InRangeBounds& sat) {
+        int v = std::max(b, std::max(g, r));
+        int diff = v - std::min(b, std::min(g, r));
+        int s = (diff * t.sdiv[v] + (1 << (kHsvShift - 1))) >> kHsvShift;
+        if (!sat.Contains(s)) return false;
+        int h = v == r ? g - b : v == g ? b - r + 2 * diff : r - g + 4 * diff;
+        h = (h * t.hdiv[diff] + (1 << (kHsvShift - 1))) >> kHsvShift;
+        if (h < 0) h += 180;
+        return hue.Contains(h);
+    }
+
+#if HSV_THRESHOLD_NEON
+    const int kBlock = 16;
+
+    // 255 where the value of the pixel is in [lo, hi], for a block of pixels.
+    // Returns false if there are none.
+    inline bool ValueInRange(const uint8_t* src, uint8_t* out, uint8x16_t lo, uint8x16_t hi) {
+        uint8x16x3_t p = vld3q_u8(src);
+        uint8x16_t v = vmaxq_u8(vmaxq_u8(p.val[0], p.val[1]), p.val[2]);
+        uint8x16_t in = vandq_u8(vcgeq_u8(v, lo), vcleq_u8(v, hi));
+        vst1q_u8(out, in);
+        uint8x8_t any = vorr_u8(vget_low_u8(in), vget_high_u8(in));
+        return vget_lane_u64(vreinterpret_u64_u8(any), 0) != 0;
+    }
+#elif HSV_THRESHOLD_SSE2
+    const int kBlock = 32;
+
+    // Splits 32 interleaved BGR pixels in a[0..5] into b, g and r halves,
+    // a[0..1] being b, a[2..3] g and a[4..5] r afterwards
+    inline void Deinterleave(__m128i a[6]) {
+        for (int layer = 0; layer < 5; ++layer) {
+            __m128i c0 = _mm_unpacklo_epi8(a[0], a[3]);
+            __m128i c1 = _mm_unpackhi_epi8(a[0], a[3]);
+            __m128i c2 = _mm_unpacklo_epi8(a[1], a[4]);
+            __m128i c3 = _mm_unpackhi_epi8(a[1], a[4]);
+            __m128i c4 = _mm_unpacklo_epi8(a[2], a[5]);
+            __m128i c5 = _mm_unpackhi_epi8(a[2], a[5]);
+            a[0] = c0;
+            a[1] = c1;
+            a[2] = c2;
+            a[3] = c3;
+            a[4] = c4;
+            a[5] = c5;
+        }
+    }
+
+    inline bool ValueInRange(const uint8_t* src, uint8_t* out, __m128i lo, __m128i hi) {
+        __m128i a[6];
+        for (int k = 0; k < 6; ++k) a[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16 * k));
+        Deinterleave(a);
+        bool any = false;
+        for (int k = 0; k < 2; ++k) {
+            __m128i v = _mm_max_epu8(_mm_max_epu8(a[k], a[k + 2]), a[k + 4]);
+            // Unsigned v >= lo and v <= hi
+            __m128i in = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, lo), v), _mm_cmpeq_epi8(_mm_min_epu8(v, hi), v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * k), in);
+            any = any || _mm_movemask_epi8(in) != 0;
+        }
+        return any;
+    }
+#endif
+}  // namespace
+
+void fusedHsvThreshold(const cv::Mat& bgr, const double hue[2], const double sat[2], const double val[2],
+                       cv::Mat& mask) {
+    CV_Assert(bgr.type() == CV_8UC3);
+    const HsvTables& tables = HsvTables::Get();
+    InRangeBounds h(hue[0], hue[1]), s(sat[0], sat[1]), v(val[0], val[1]);
+    mask.create(bgr.size(), CV_8UC1);
+    if (h.Empty() || s.Empty() || v.Empty()) {
+        mask.setTo(cv::Scalar::all(0));
+        return;
+    }
+
+#if HSV_THRESHOLD_NEON
+    uint8x16_t lo = vdupq_n_u8(v.lo);
+    uint8x16_t hi = vdupq_n_u8(v.hi);
+#elif HSV_THRESHOLD_SSE2
+    __m128i lo = _mm_set1_epi8(static_cast<char>(v.lo));
+    __m128i hi = _mm_set1_epi8(static_cast<char>(v.hi));
+#endif
+
+    for (int y = 0; y < bgr.rows; ++y) {
+        const uint8_t* src = bgr.ptr<uint8_t>(y);
+        uint8_t* out = mask.ptr<uint8_t>(y);
+        int x = 0;
+#if HSV_THRESHOLD_NEON || HSV_THRESHOLD_SSE2
+        for (; x + kBlock <= bgr.cols; x += kBlock) {
+            if (!ValueInRange(src + 3 * x, out + x, lo, hi)) continue;
+            for (int i = x; i < x + kBlock; ++i) {
+                if (out[i] && !HueSatInRange(src[3 * i], src[3 * i + 1], src[3 * i + 2], tables, h, s)) out[i] = 0;
+            }
+        }
+#endif
+        for (; x < bgr.cols; ++x) {
+            const uint8_t* p = src + 3 * x;
+            int value = std::max(p[0], std::max(p[1], p[2]));
+            out[x] = v.Contains(value) && HueSatInRange(p[0], p[1], p[2], tables, h, s) ? 255 : 0;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Inclusive bounds of one channel as cv::inRange uses them for an 8 bit
+ * image: rounded to int, and matching nothing if they cross or miss 0-255,
+ * so [-5, -1] matches nothing rather than 0.
+ */
+struct InRangeBounds {
+    int lo;
+    int hi;
+
+    InRangeBounds(double lower, double upper) {
+        lo = cvRound(lower);
+        hi = cvRound(upper);
+        if (lo > hi || lo > 255 || hi < 0) {
+            lo = 1;
+            hi = 0;
+        }
+        lo = std::max(lo, 0);
+        hi = std::min(hi, 255);
+    }
+
+    bool Empty() const { return lo > hi; }
+    bool Contains(int x) const { return x >= lo && x <= hi; }
+};
+
+/**
+ * The fixed point reciprocals cv::cvtColor uses for 8 bit BGR to HSV, so hue
+ * and saturation worked out with them come out exactly as they would from
+ * it:
+ *
+ *     s = (diff * sdiv[v] + (1 << (kShift - 1))) >> kShift
+ *     h = (h6 * hdiv[diff] + (1 << (kShift - 1))) >> kShift
+ */
+struct HsvTables {
+    static const int kShift = 12;
+
+    int sdiv[256];
+    int hdiv[256];
+
+    static const HsvTables& Get();
+
+    private:
+    HsvTables();
+};
+
+/**
+ * The mask cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV) followed by
+ * cv::inRange(hsv, (hue[0], sat[0], val[0]), (hue[1], sat[1], val[1]), mask)
+ * gives, bit for bit, in one pass over the image and without the HSV image
+ * in between. Bounds are taken as InRangeBounds, hue is 0-180.
+ *
+ * The value test is done for a block of pixels at a time with NEON or SSE2
+ * when the compiler targets it, and whole blocks of dark (or bright) pixels
+ * are rejected without computing hue or saturation. The pixels left get the
+ * exact fixed point hue and saturation of OpenCV's own conversion.
+ *
+ * bgr must be CV_8UC3.
+ */
+void fusedHsvThreshold(const cv::Mat& bgr, const double hue[2], const double sat[2], const double val[2],
+                       cv::Mat& mask);
@@ -0,0 +1,66 @@
+#include "LatencyTracker.h"
+
+#include <networktables/NetworkTableInstance.h>
+
+void LatencyHistogram::Record(uint64_t micros) {
+    uint64_t bucket = micros / kBucketMicros;
+    if (bucket >= kBuckets) bucket = kBuckets - 1;
+    m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Drain(uint32_t* counts) {
+    for (int i = 0; i < kBuckets; ++i) counts[i] = m_counts[i].exchange(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Percentile(const uint32_t* counts, double fraction) {
+    uint64_t total = 0;
+    for (int i = 0; i < kBuckets; ++i) total += counts[i];
+    if (total == 0) return 0.0;
+
+    uint64_t wanted = uint64_t(fraction * total + 0.5);
+    if (wanted == 0) wanted = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        // Report the top of the bucket so the value is never optimistic
+        if (seen >= wanted) return (i + 1) * kBucketMicros / 1000.0;
+    }
+    return kBuckets * kBucketMicros / 1000.0;
+}
+
+void StageLatency::Record(uint64_t captureTime, uint64_t processTime, uint64_t publishTime) {
+    // The capture time comes from another clock read, guard against it being
+    // a little ahead
+    captureToProcess.Record(processTime > captureTime ? processTime - captureTime : 0);
+    processToPublish.Record(publishTime > processTime ? publishTime - processTime : 0);
+    total.Record(publishTime > captureTime ? publishTime - captureTime : 0);
+}
+
+LatencyTracker::LatencyTracker(const std::string& camera) {
+    auto table = nt::NetworkTableInstance::GetDefault().GetTable("CameraLatency")->GetSubTable(camera);
+    m_vision = table->GetSubTable("vision");
+    m_stream = table->GetSubTable("stream");
+}
+
+void LatencyTracker::Publish() {
+    Publish(*m_vision, vision);
+    Publish(*m_stream, stream);
+}
+
+void LatencyTracker::Publish(nt::NetworkTable& table, StageLatency& stage) {
+    struct {
+        const char* name;
+        LatencyHistogram& histogram;
+    } stages[] = {
+        {"capture to process", stage.captureToProcess},
+        {"process to publish", stage.processToPublish},
+        {"total", stage.total},
+    };
+    for (auto& s : stages) {
+        s.histogram.Drain(m_drained);
+        std::string name = s.name;
+        table.PutNumber(name + " p50", LatencyHistogram::Percentile(m_drained, 0.50));
+        table.PutNumber(name + " p95", LatencyHistogram::Percentile(m_drained, 0.95));
+        table.PutNumber(name + " p99", LatencyHistogram::Percentile(m_drained, 0.99));
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <networktables/NetworkTable.h>
+
+/**
+ * Histogram of latencies in 0.25 ms buckets up to 256 ms. Recording is lock
+ * free so any thread can record into it.
+ */
+class LatencyHistogram {
+    public:
+    void Record(uint64_t micros);
+
+    /**
+     * Take the counts recorded since the last call and clear them, so each
+     * report covers only its own period.
+     */
+    void Drain(uint32_t* counts);
+
+    static constexpr int kBuckets = 1024;
+    static constexpr uint64_t kBucketMicros = 250;
+
+    /**
+     * Latency in milliseconds below which fraction of the drained counts fall.
+     */
+    static double Percentile(const uint32_t* counts, double fraction);
+
+    private:
+    // The last bucket also holds everything over the range
+    std::atomic<uint32_t> m_counts[kBuckets] = {};
+};
+
+/**
+ * Latency of one kind of consumer of a camera, split into stages:
+ *  - capture to process: from the camera capture time until the consumer
+ *    starts on the frame, i.e. decode and queueing
+ *  - process to publish: the consumer's own work until the result or frame
+ *    has been sent
+ *  - total: capture until sent
+ */
+struct StageLatency {
+    LatencyHistogram captureToProcess;
+    LatencyHistogram processToPublish;
+    LatencyHistogram total;
+
+    void Record(uint64_t captureTime, uint64_t processTime, uint64_t publishTime);
+};
+
+/**
+ * Latency histograms of one camera, kept separately for vision results and
+ * dashboard streams. Percentiles are published to NetworkTables under
+ * CameraLatency/<camera>/<vision|stream>.
+ */
+class LatencyTracker {
+    public:
+    explicit LatencyTracker(const std::string& camera);
+
+    StageLatency vision;
+    StageLatency stream;
+
+    /**
+     * Publish p50, p95 and p99 in milliseconds of everything recorded since the
+     * last call.
+     */
+    void Publish();
+
+    private:
+    void Publish(nt::NetworkTable& table, StageLatency& stage);
+
+    std::shared_ptr<nt::NetworkTable> m_vision;
+    std::shared_ptr<nt::NetworkTable> m_stream;
+    // Scratch for the drained counts
+    uint32_t m_drained[LatencyHistogram::kBuckets];
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+
+/**
+ * Single producer, single consumer "latest value wins" mailbox.
+ *
+ * Three slots are rotated with atomic exchanges: the producer always owns one
+ * to write into, the consumer owns one to read from and the third holds the
+ * newest published value. Publishing never blocks and never waits for the
+ * consumer. If the consumer has not taken the previous value it is simply
+ * replaced and counted as overwritten, so a slow consumer always gets the
+ * freshest frame.
+ *
+ * A waiting consumer sleeps on a futex that the producer only wakes when
+ * somebody is actually waiting.
+ */
+template <typename T>
+class LatestFrameMailbox {
+    public:
+    /**
+     * Make value the newest one. Never blocks.
+     */
+    void Publish(T value) {
+        m_slots[m_back] = std::move(value);
+        uint32_t prev = m_middle.exchange(m_back | kFresh, std::memory_order_acq_rel);
+        m_back = prev & kIndex;
+        // Drop whatever the slot we got back was holding so frame buffers are
+        // returned to their pool straight away
+        m_slots[m_back] = T();
+
+        m_published.fetch_add(1, std::memory_order_relaxed);
+        if (prev & kFresh) m_overwritten.fetch_add(1, std::memory_order_relaxed);
+
+        // Sequentially consistent so either we see the consumer waiting or it
+        // sees the new sequence number and does not go to sleep
+        m_sequence.fetch_add(1, std::memory_order_seq_cst);
+        if (m_waiting.load(std::memory_order_seq_cst)) Futex(FUTEX_WAKE_PRIVATE, 1, nullptr);
+    }
+
+    /**
+     * Take the newest value if there is one that has not been taken yet.
+     */
+    bool TryTake(T& value) {
+        if (!(m_middle.load(std::memory_order_acquire) & kFresh)) return false;
+        uint32_t prev = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = prev & kIndex;
+        value = std::move(m_slots[m_front]);
+        m_slots[m_front] = T();
+        return true;
+    }
+
+    /**
+     * Take the newest value, waiting up to timeout for one to be published.
+     */
+    bool WaitTake(T& value, std::chrono::milliseconds timeout) {
+        uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+        if (TryTake(value)) return true;
+
+        struct timespec ts;
+        ts.tv_sec = timeout.count() / 1000;
+        ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+        m_waiting.store(true, std::memory_order_seq_cst);
+        // Sleeps only if nothing was published since we read the sequence
+        Futex(FUTEX_WAIT_PRIVATE, sequence, &ts);
+        m_waiting.store(false, std::memory_order_relaxed);
+        return TryTake(value);
+    }
+
+    /**
+     * Wake a waiting consumer without publishing, e.g. to shut it down.
+     */
+    void Wake() {
+        m_sequence.fetch_add(1, std::memory_order_release);
+        Futex(FUTEX_WAKE_PRIVATE, 1, nullptr);
+    }
+
+    /**
+     * Number of values published so far.
+     */
+    uint64_t GetPublished() const { return m_published.load(std::memory_order_relaxed); }
+
+    /**
+     * Number of values that were replaced before the consumer took them.
+     */
+    uint64_t GetOverwritten() const { return m_overwritten.load(std::memory_order_relaxed); }
+
+    private:
+    static constexpr uint32_t kIndex = 0x3;
+    static constexpr uint32_t kFresh = 0x4;
+
+    long Futex(int op, uint32_t value, const struct timespec* timeout) {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_sequence), op, value, timeout, nullptr, 0);
+    }
+
+    T m_slots[3];
+    // Only touched by the producer
+    uint32_t m_back = 0;
+    // Only touched by the consumer
+    uint32_t m_front = 1;
+    std::atomic<uint32_t> m_middle{2};
+
+    std::atomic<uint32_t> m_sequence{0};
+    std::atomic<bool> m_waiting{false};
+    std::atomic<uint64_t> m_published{0};
+    std::atomic<uint64_t> m_overwritten{0};
+
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32 bit word");
+};
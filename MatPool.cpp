@@ -0,0 +1,111 @@
+#include "MatPool.h"
+
+#include <new>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+MatPool& MatPool::GetInstance() {
+    // Never destroyed, Mats may still be freed by other threads during exit
+    static MatPool* instance = new MatPool();
+    return *instance;
+}
+
+void MatPool::Install() {
+    cv::Mat::setDefaultAllocator(this);
+    Unsettle();
+}
+
+void MatPool::Unsettle(uint64_t settle) {
+    m_settledAt = wpi::Now() + settle;
+    m_clean = true;
+}
+
+cv::UMatData* MatPool::allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags,
+                                cv::UMatUsageFlags usageFlags) const {
+    // Memory the caller owns is none of our business
+    if (data) return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+
+    // Continuous, like the standard allocator
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) step[i] = total;
+        total *= sizes[i];
+    }
+
+    cv::UMatData* u = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_free.find(total);
+        if (it != m_free.end() && !it->second.empty()) {
+            u = it->second.back();
+            it->second.pop_back();
+            m_pooledBytes -= total;
+        }
+    }
+    if (u) {
+        // Make it a fresh UMatData again without going to the heap
+        uchar* buffer = u->origdata;
+        u->~UMatData();
+        new (u) cv::UMatData(this);
+        u->data = u->origdata = buffer;
+        u->size = total;
+        return u;
+    }
+
+    m_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    u = new cv::UMatData(this);
+    u->data = u->origdata = static_cast<uchar*>(cv::fastMalloc(total));
+    u->size = total;
+    return u;
+}
+
+bool MatPool::allocate(cv::UMatData* data, int, cv::UMatUsageFlags) const {
+    return data != nullptr;
+}
+
+void MatPool::deallocate(cv::UMatData* u) const {
+    if (!u) return;
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pooledBytes + u->size <= m_limit) {
+            m_free[u->size].push_back(u);
+            m_pooledBytes += u->size;
+            return;
+        }
+    }
+    cv::fastFree(u->origdata);
+    u->origdata = nullptr;
+    delete u;
+}
+
+bool MatPool::IsMatAllocationFree() const {
+    return wpi::Now() >= m_settledAt && m_clean;
+}
+
+void MatPool::Publish() {
+    uint64_t allocations = m_heapAllocations;
+    uint64_t recent = allocations - m_published;
+    m_published = allocations;
+    if (recent > 0 && wpi::Now() >= m_settledAt) {
+        // A size nobody asked for before, e.g. a new dashboard viewer, is
+        // expected once. Anything that keeps coming is a Mat not being reused.
+        m_steadyAllocations += recent;
+        m_clean = false;
+        wpi::errs() << "MatPool: " << recent << " buffers allocated from the heap while settled\n";
+    }
+
+    size_t pooled;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pooled = m_pooledBytes;
+    }
+    if (!m_table) m_table = nt::NetworkTableInstance::GetDefault().GetTable("CameraMemory");
+    m_table->PutNumber("heap allocations", allocations);
+    m_table->PutNumber("steady allocations", m_steadyAllocations);
+    m_table->PutNumber("pooled MB", pooled / 1048576.0);
+    m_table->PutBoolean("mat allocation free", IsMatAllocationFree());
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <networktables/NetworkTable.h>
+#include <opencv2/core/core.hpp>
+
+/**
+ * cv::Mat allocator that keeps freed image buffers and hands them out again
+ * to the next Mat of the same byte size, so the temporaries OpenCV and the
+ * pipelines create for every frame stop going to the heap once the first few
+ * frames have been through. Installed for every Mat with Install().
+ *
+ * Frame sizes hardly ever change, so buffers are only reused for exactly the
+ * same size. At most the limit's worth of freed buffers is kept, anything
+ * freed beyond that goes back to the heap.
+ *
+ * Every Mat buffer that has to come from the heap is counted. Once the
+ * cameras have settled after starting or a config change, any further heap
+ * allocation means something in the frame loop is not reusing its Mats, and
+ * Publish() reports it. Only Mats go through the pool: vectors of results
+ * and what NetworkTables allocates to publish them are not counted.
+ */
+class MatPool : public cv::MatAllocator {
+    public:
+    static MatPool& GetInstance();
+
+    /**
+     * Use the pool for every Mat allocated from now on. Mats that already
+     * exist keep their allocator.
+     */
+    void Install();
+
+    /**
+     * Most bytes to keep in freed buffers.
+     */
+    void SetLimit(size_t bytes) { m_limit = bytes; }
+
+    /**
+     * Heap allocations from now on are not expected for settle microseconds,
+     * e.g. after cameras were started or changed.
+     */
+    void Unsettle(uint64_t settle = kSettleTime);
+
+    /**
+     * Buffers that came from the heap rather than the pool, since the start
+     * and since the cameras settled.
+     */
+    uint64_t GetHeapAllocations() const { return m_heapAllocations; }
+    uint64_t GetSteadyAllocations() const { return m_steadyAllocations; }
+
+    /**
+     * The cameras have settled since the last Unsettle() and no Mat in the
+     * frame loop has gone to the heap since. Published as "mat allocation
+     * free" so a monitor or test can check the loop keeps reusing its Mats
+     * after warm up; says nothing about other allocations. Only up to date
+     * after Publish().
+     */
+    bool IsMatAllocationFree() const;
+
+    /**
+     * Count heap allocations made while the cameras were settled, warn about
+     * them and put the counters in NetworkTables under CameraMemory. Call
+     * about once a second.
+     */
+    void Publish();
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, int flags,
+                           cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, int accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+    private:
+    MatPool() = default;
+
+    static const uint64_t kSettleTime = 10000000;
+
+    std::atomic<size_t> m_limit{32 << 20};
+
+    mutable std::mutex m_mutex;
+    // Freed buffers by byte size
+    mutable std::unordered_map<size_t, std::vector<cv::UMatData*>> m_free;
+    mutable size_t m_pooledBytes = 0;
+
+    mutable std::atomic<uint64_t> m_heapAllocations{0};
+    std::atomic<uint64_t> m_steadyAllocations{0};
+    uint64_t m_published = 0;
+    std::atomic<uint64_t> m_settledAt{0};
+    // No Mat went to the heap since the last Unsettle() settled
+    std::atomic_bool m_clean{true};
+    std::shared_ptr<nt::NetworkTable> m_table;
+};
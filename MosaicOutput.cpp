@@ -0,0 +1,109 @@
+#include "MosaicOutput.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <wpi/raw_ostream.h>
+
+#include "cameraserver/CameraServer.h"
+#include "BoxDownscale.h"
+#include "Scheduler.h"
+
+class MosaicOutput::Tile : public FrameConsumer {
+    public:
+    Tile(const std::string& mosaic, const MosaicTile& tile, const std::shared_ptr<Canvas>& canvas,
+         const cs::CvSource& svr)
+        : m_name(mosaic), m_tile(tile), m_canvas(canvas), m_svr(svr) {}
+
+    void OnFrame(const FramePtr& frame) override {
+        const cv::Mat& image = frame->image;
+        if (image.type() != CV_8UC3) {
+            // A raw camera's YUYV frame, shrunk and converted by the pyramid
+            cv::Mat scaled = frame->Scaled(m_tile.rect.size());
+            std::lock_guard<std::mutex> lock(m_canvas->mutex);
+            scaled.copyTo(m_canvas->image(m_tile.rect));
+            m_canvas->changed = true;
+            return;
+        }
+        // Scaled straight into the canvas: the tile is already the right size
+        // and type, so nothing is allocated and there is no copy
+        std::lock_guard<std::mutex> lock(m_canvas->mutex);
+        cv::Mat tile = m_canvas->image(m_tile.rect);
+        areaDownscale(image, tile, tile.size());
+        m_canvas->changed = true;
+    }
+
+    int GetDivider() const override { return m_tile.divider; }
+    bool IsActive() const override { return m_svr.IsEnabled(); }
+    std::string GetName() const override { return m_name; }
+
+    const std::string& GetCamera() const { return m_tile.camera; }
+
+    private:
+    std::string m_name;
+    MosaicTile m_tile;
+    std::shared_ptr<Canvas> m_canvas;
+    cs::CvSource m_svr;
+};
+
+MosaicOutput::MosaicOutput(const MosaicConfig& config)
+    : m_config(config), m_canvas(std::make_shared<Canvas>()) {
+    m_svr = frc::CameraServer::GetInstance()->PutVideo(config.name, config.width, config.height);
+    m_canvas->image = cv::Mat(config.height, config.width, CV_8UC3, cv::Scalar::all(0));
+
+    cv::Rect whole(0, 0, config.width, config.height);
+    for (auto& tile : config.tiles) {
+        MosaicTile t = tile;
+        t.rect &= whole;
+        if (t.rect.area() == 0) {
+            wpi::errs() << "mosaic '" << config.name << "': tile of camera '" << tile.camera
+            << "' is outside the mosaic, skipping it\n";
+            continue;
+        }
+        t.divider = std::max(1, t.divider);
+        m_tiles.push_back(std::make_shared<Tile>(config.name, t, m_canvas, m_svr));
+    }
+    m_thread = std::thread(&MosaicOutput::Run, this);
+}
+
+MosaicOutput::~MosaicOutput() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_cv.notify_one();
+    }
+    if (m_thread.joinable()) m_thread.join();
+    Detach();
+    auto inst = frc::CameraServer::GetInstance();
+    inst->RemoveServer("serve_" + m_config.name);
+    inst->RemoveCamera(m_config.name);
+}
+
+void MosaicOutput::Attach(const std::string& camera, FrameHub& hub) {
+    for (auto& tile : m_tiles) {
+        if (tile->GetCamera() != camera) continue;
+        hub.AddConsumer(tile);
+        m_attached.emplace_back(&hub, tile);
+    }
+}
+
+void MosaicOutput::Detach() {
+    for (auto& attached : m_attached) attached.first->RemoveConsumer(attached.second);
+    m_attached.clear();
+}
+
+void MosaicOutput::Run() {
+    Scheduler& scheduler = Scheduler::GetInstance();
+    auto period = std::chrono::microseconds(1000000 / std::max(1, m_config.fps));
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        // Slow down with the other streams while vision is missing deadlines
+        m_cv.wait_for(lock, period * scheduler.GetStreamSlowdown(), [this] { return !m_running; });
+        if (!m_running) break;
+
+        std::lock_guard<std::mutex> canvasLock(m_canvas->mutex);
+        if (!m_canvas->changed) continue;
+        m_svr.PutFrame(m_canvas->image);
+        m_canvas->changed = false;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cscore.h>
+#include <opencv2/core/core.hpp>
+
+#include "FrameHub.h"
+
+/**
+ * One camera's place in a mosaic.
+ */
+struct MosaicTile {
+    // Name of the camera shown
+    std::string camera;
+    // Where in the mosaic, the camera frame is scaled to its size
+    cv::Rect rect;
+    // Only every nth camera frame is drawn into the tile
+    int divider = 2;
+
+    bool operator==(const MosaicTile& other) const {
+        return camera == other.camera && rect == other.rect && divider == other.divider;
+    }
+};
+
+/**
+ * A dashboard stream made of several cameras, from the "mosaics" list in
+ * /boot/frc.json.
+ */
+struct MosaicConfig {
+    // Name of the stream sent to the dashboard
+    std::string name;
+    int width = 640;
+    int height = 240;
+    // Most frames per second sent
+    int fps = 15;
+    std::vector<MosaicTile> tiles;
+
+    bool operator==(const MosaicConfig& other) const {
+        return name == other.name && width == other.width && height == other.height && fps == other.fps &&
+               tiles == other.tiles;
+    }
+    bool operator!=(const MosaicConfig& other) const { return !(*this == other); }
+};
+
+/**
+ * Tiles the latest frames of several cameras into a single dashboard stream,
+ * so the driver station gets one encoder and one connection instead of one
+ * per camera.
+ *
+ * Each tile is a FrameConsumer of its camera's FrameHub, running at its own
+ * divider. It shrinks the frame with areaDownscale() straight into its
+ * place in the canvas, with no image in between, only a raw camera's YUYV
+ * frame comes from the frame pyramid and is copied. The canvas is sent, and so encoded once, at most fps times a second
+ * and only if a tile changed since. Nothing is captured for the mosaic while
+ * nobody watches it.
+ */
+class MosaicOutput {
+    public:
+    explicit MosaicOutput(const MosaicConfig& config);
+    ~MosaicOutput();
+
+    MosaicOutput(const MosaicOutput&) = delete;
+    MosaicOutput& operator=(const MosaicOutput&) = delete;
+
+    /**
+     * Feed the tiles showing camera from its hub.
+     */
+    void Attach(const std::string& camera, FrameHub& hub);
+
+    /**
+     * Take the tiles off every hub, e.g. before cameras are stopped.
+     */
+    void Detach();
+
+    const MosaicConfig& GetConfig() const { return m_config; }
+
+    private:
+    class Tile;
+
+    // Shared with the tiles, which may outlive the mosaic on a hub thread
+    struct Canvas {
+        std::mutex mutex;
+        cv::Mat image;
+        bool changed = false;
+    };
+
+    void Run();
+
+    MosaicConfig m_config;
+    cs::CvSource m_svr;
+    std::shared_ptr<Canvas> m_canvas;
+    std::vector<std::shared_ptr<Tile>> m_tiles;
+    std::vector<std::pair<FrameHub*, std::shared_ptr<Tile>>> m_attached;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_running = true;
+    std::thread m_thread;
+};
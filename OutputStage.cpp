@@ -0,0 +1,170 @@
+#include "OutputStage.h"
+
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "BoxDownscale.h"
+#include "YuyvKernels.h"
+
+namespace {
+
+    // Draws the static part of an overlay. Anti-aliasing is off so every
+    // pixel drawn is exactly the overlay colour.
+    void Draw(cv::Mat& image, const Overlay& overlay, const cv::Scalar& color) {
+        const cv::Point& c = overlay.position;
+        int near = overlay.gap;
+        int far = overlay.gap + overlay.length;
+        switch (overlay.kind) {
+            case Overlay::kCrosshair:
+                cv::line(image, cv::Point(c.x, c.y - far), cv::Point(c.x, c.y - near), color, overlay.thickness, cv::LINE_8);
+                cv::line(image, cv::Point(c.x, c.y + near), cv::Point(c.x, c.y + far), color, overlay.thickness, cv::LINE_8);
+                cv::line(image, cv::Point(c.x - far, c.y), cv::Point(c.x - near, c.y), color, overlay.thickness, cv::LINE_8);
+                cv::line(image, cv::Point(c.x + near, c.y), cv::Point(c.x + far, c.y), color, overlay.thickness, cv::LINE_8);
+                break;
+            case Overlay::kBox:
+                cv::rectangle(image, cv::Rect(c, overlay.size), color, overlay.thickness, cv::LINE_8);
+                break;
+            case Overlay::kText:
+                cv::putText(image, overlay.text, c, cv::FONT_HERSHEY_SIMPLEX, overlay.scale, color, overlay.thickness, cv::LINE_8);
+                break;
+            case Overlay::kTargets:
+                break;
+        }
+    }
+
+    // BT.601, as cv::cvtColor uses for BGR to gray
+    uint8_t Luma(const cv::Scalar& color) {
+        return cv::saturate_cast<uint8_t>(0.114 * color[0] + 0.587 * color[1] + 0.299 * color[2]);
+    }
+}  // namespace
+
+Overlay Overlay::Scaled(double factor) const {
+    if (factor == 1.0) return *this;
+    Overlay scaled = *this;
+    scaled.position = cv::Point(cvRound(position.x * factor), cvRound(position.y * factor));
+    scaled.size = cv::Size(cvRound(size.width * factor), cvRound(size.height * factor));
+    scaled.length = cvRound(length * factor);
+    scaled.gap = cvRound(gap * factor);
+    scaled.scale = scale * factor;
+    scaled.thickness = std::max(1, cvRound(thickness * factor));
+    return scaled;
+}
+
+OutputStage::OutputStage(cv::Size size, const cv::Rect& crop, const std::vector<Overlay>& overlays, bool gray)
+    : m_size(size), m_crop(crop), m_gray(gray) {
+    Rasterize(overlays);
+}
+
+void OutputStage::Rasterize(const std::vector<Overlay>& overlays) {
+    // Draw everything once into a scratch image, marking the pixels drawn in a
+    // mask, then keep only the runs of marked pixels
+    cv::Mat canvas(m_size, CV_8UC3, cv::Scalar::all(0));
+    cv::Mat mask(m_size, CV_8UC1, cv::Scalar::all(0));
+    for (auto& overlay : overlays) {
+        if (overlay.kind == Overlay::kTargets) {
+            m_drawTargets = true;
+            m_targetColor = overlay.color;
+            m_targetThickness = overlay.thickness;
+            continue;
+        }
+        Draw(canvas, overlay, overlay.color);
+        Draw(mask, overlay, cv::Scalar(255));
+    }
+
+    for (int y = 0; y < m_size.height; ++y) {
+        const uint8_t* marked = mask.ptr<uint8_t>(y);
+        const cv::Vec3b* colors = canvas.ptr<cv::Vec3b>(y);
+        int x = 0;
+        while (x < m_size.width) {
+            if (!marked[x]) {
+                ++x;
+                continue;
+            }
+            const cv::Vec3b& c = colors[x];
+            Run run{y, x, 0, c, Luma(cv::Scalar(c[0], c[1], c[2]))};
+            while (x < m_size.width && marked[x] && colors[x] == run.color) {
+                ++run.length;
+                ++x;
+            }
+            m_runs.push_back(run);
+        }
+    }
+}
+
+const cv::Mat& OutputStage::Render(const cv::Mat& frame, const std::vector<cv::Rect>& targets) {
+    bool yuyv = frame.type() == CV_8UC2;
+    cv::Rect whole(0, 0, frame.cols, frame.rows);
+    cv::Rect crop = m_crop.area() > 0 ? m_crop & whole : whole;
+    if (yuyv) {
+        // Keep whole Y,U,Y,V groups
+        crop.x &= ~1;
+        crop.width &= ~1;
+    }
+    if (crop.area() == 0) crop = whole;
+    // Only a header, no pixels are copied
+    cv::Mat view = frame(crop);
+
+    bool drawing = !m_runs.empty() || (m_drawTargets && !targets.empty());
+    if (!yuyv && !m_gray && view.size() == m_size && !drawing && view.isContinuous()) {
+        // Nothing to change, send the frame itself
+        m_passed = view;
+        return m_passed;
+    }
+    m_passed.release();
+
+    if (m_gray) {
+        if (yuyv && view.size() == m_size) {
+            // The Y plane already is the gray image
+            yuyvLuma(view, m_image);
+        } else if (yuyv) {
+            yuyvLuma(view, m_converted);
+            areaDownscale(m_converted, m_image, m_size);
+        } else if (view.size() == m_size) {
+            cv::cvtColor(view, m_image, cv::COLOR_BGR2GRAY);
+        } else {
+            // Shrink first so fewer pixels get converted
+            areaDownscale(view, m_converted, m_size);
+            cv::cvtColor(m_converted, m_image, cv::COLOR_BGR2GRAY);
+        }
+    } else if (yuyv) {
+        // Shrink before converting to BGR where possible, so fewer pixels
+        // get converted
+        int factor = view.cols / m_size.width;
+        if ((factor == 1 || factor == 2 || factor == 4) && view.cols == m_size.width * factor &&
+            view.rows == m_size.height * factor) {
+            yuyvToBgr(view, m_image, factor);
+        } else {
+            yuyvToBgr(view, m_converted);
+            areaDownscale(m_converted, m_image, m_size);
+        }
+    } else if (view.size() == m_size) {
+        view.copyTo(m_image);
+    } else {
+        areaDownscale(view, m_image, m_size);
+    }
+
+    if (m_gray) {
+        for (auto& run : m_runs) {
+            uint8_t* row = m_image.ptr<uint8_t>(run.y);
+            std::fill(row + run.x, row + run.x + run.length, run.gray);
+        }
+    } else {
+        for (auto& run : m_runs) {
+            cv::Vec3b* row = m_image.ptr<cv::Vec3b>(run.y);
+            std::fill(row + run.x, row + run.x + run.length, run.color);
+        }
+    }
+
+    if (m_drawTargets) {
+        double sx = static_cast<double>(m_size.width) / crop.width;
+        double sy = static_cast<double>(m_size.height) / crop.height;
+        cv::Scalar color = m_gray ? cv::Scalar(Luma(m_targetColor)) : m_targetColor;
+        for (auto& target : targets) {
+            cv::Rect r(cvRound((target.x - crop.x) * sx), cvRound((target.y - crop.y) * sy),
+                       cvRound(target.width * sx), cvRound(target.height * sy));
+            cv::rectangle(m_image, r, color, m_targetThickness, cv::LINE_8);
+        }
+    }
+    return m_image;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Something drawn on a dashboard stream. Positions and sizes are in output
+ * pixels, after cropping and scaling.
+ */
+struct Overlay {
+    enum Kind {
+        // Four arms around position, leaving gap pixels open in the middle
+        kCrosshair,
+        // Rectangle outline at position of the given size
+        kBox,
+        // Text with its bottom left corner at position
+        kText,
+        // Not drawn itself, sets the colour and thickness of the target boxes
+        // passed to OutputStage::Render()
+        kTargets
+    };
+
+    Kind kind = kCrosshair;
+    cv::Point position;
+    cv::Size size;
+    int length = 25;
+    int gap = 15;
+    std::string text;
+    double scale = 0.5;
+    // BGR
+    cv::Scalar color{0, 0, 255};
+    int thickness = 1;
+
+    /**
+     * The same overlay for an output scaled by factor.
+     */
+    Overlay Scaled(double factor) const;
+
+    bool operator==(const Overlay& other) const {
+        return kind == other.kind && position == other.position && size == other.size &&
+               length == other.length && gap == other.gap && text == other.text &&
+               scale == other.scale && color == other.color && thickness == other.thickness;
+    }
+    bool operator!=(const Overlay& other) const { return !(*this == other); }
+};
+
+/**
+ * Turns a camera frame into a dashboard frame: crops it, scales it to the
+ * output size and draws the overlays, touching each output pixel once.
+ *
+ * The crop is only a view of the frame so nothing outside it is read. The
+ * scaled image is written straight into the output buffer, using
+ * boxDownscale() for 2:1 and 4:1. Crosshairs, boxes and text never move, so
+ * they are rasterised once into runs of pixels that are copied over the
+ * output, instead of being drawn with OpenCV on every frame. Only the target
+ * boxes, which change with every frame, are drawn each time.
+ *
+ * YUYV frames from a raw camera are shrunk and converted to BGR in one go by
+ * yuyvToBgr() when the ratio allows it.
+ *
+ * A gray stage outputs CV_8UC1, which cscore sends as a single component
+ * JPEG. It takes the Y plane of YUYV frames as it is and converts BGR frames
+ * only after shrinking them. The overlays are drawn in their luma.
+ */
+class OutputStage {
+    public:
+    /**
+     * An empty crop means the whole frame.
+     */
+    OutputStage(cv::Size size, const cv::Rect& crop, const std::vector<Overlay>& overlays, bool gray = false);
+
+    /**
+     * Produce the output for frame. targets are in frame pixels and are drawn
+     * only if there is a kTargets overlay. The result stays valid until the
+     * next call and may share its pixels with frame, so it must not be
+     * written to.
+     */
+    const cv::Mat& Render(const cv::Mat& frame, const std::vector<cv::Rect>& targets);
+
+    cv::Size GetSize() const { return m_size; }
+    const cv::Rect& GetCrop() const { return m_crop; }
+    bool IsGray() const { return m_gray; }
+
+    private:
+    // Horizontal run of pixels of one colour in the static overlay
+    struct Run {
+        int y;
+        int x;
+        int length;
+        cv::Vec3b color;
+        // Luma of color, for gray output
+        uint8_t gray;
+    };
+
+    void Rasterize(const std::vector<Overlay>& overlays);
+
+    cv::Size m_size;
+    cv::Rect m_crop;
+    bool m_gray;
+    std::vector<Run> m_runs;
+    bool m_drawTargets = false;
+    cv::Scalar m_targetColor;
+    int m_targetThickness = 1;
+
+    // Owned output buffer, reused for every frame
+    cv::Mat m_image;
+    // Header of the frame itself when it can be sent as is
+    cv::Mat m_passed;
+    // YUYV frames converted to BGR, when they cannot be shrunk first, or the
+    // Y plane or shrunk BGR image on the way to gray
+    cv::Mat m_converted;
+};
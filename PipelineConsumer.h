@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <networktables/NetworkTable.h>
+#include <networktables/NetworkTableInstance.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <wpi/timestamp.h>
+
+#include "FrameHub.h"
+
+/**
+ * Flush NetworkTables so results go out now rather than at the next update,
+ * but at most once every 20 ms however many pipelines call it, which is as
+ * often as the robot code looks at them.
+ */
+inline void throttledFlush() {
+    static std::atomic<uint64_t> last{0};
+    const uint64_t kPeriod = 20000;
+    uint64_t now = wpi::Now();
+    uint64_t previous = last;
+    if (now - previous < kPeriod || !last.compare_exchange_strong(previous, now)) return;
+    nt::NetworkTableInstance::GetDefault().Flush();
+}
+
+/**
+ * Runs a vision pipeline on the frames of a camera, like frc::VisionRunner
+ * but taking its frames from a FrameHub instead of a sink of its own. The
+ * listener is called after every run so the results can be published.
+ *
+ * The frame is shared with the other consumers of the camera, the pipeline
+ * must not write into its input image.
+ *
+ * YUYV frames from a raw camera are converted to BGR for the pipeline unless
+ * SetNativeYuyv() says it can take them as they are (see YuyvKernels.h).
+ */
+template <typename T>
+class PipelineConsumer : public FrameConsumer {
+    public:
+    PipelineConsumer(std::unique_ptr<T> pipeline, std::function<void(T&)> listener, int divider = 1)
+        : m_pipeline(std::move(pipeline)), m_listener(std::move(listener)), m_divider(divider) {}
+
+    /**
+     * After the listener has published the results of a frame, also put the
+     * frame's capture time ("captureTime", Pi clock in microseconds) and how
+     * old the frame is ("latency", seconds) into table and flush it with
+     * throttledFlush(). The robot code can subtract the latency from when it
+     * received the results to find where the robot was when the frame was
+     * taken.
+     */
+    void SetResultTable(const std::shared_ptr<nt::NetworkTable>& table) {
+        m_captureTime = table->GetEntry("captureTime");
+        m_latencyEntry = table->GetEntry("latency");
+        m_publish = true;
+    }
+
+    /**
+     * Also called after every run, after the listener, with the frame the
+     * pipeline ran on, e.g. to scale results back to camera pixels. Set
+     * before adding the consumer to the hub.
+     */
+    void SetFrameListener(std::function<void(T&, const Frame&)> listener) { m_frameListener = std::move(listener); }
+
+    /**
+     * Hand YUYV frames to the pipeline without converting them to BGR.
+     */
+    void SetNativeYuyv(bool native) { m_nativeYuyv = native; }
+
+    /**
+     * Run the pipeline on the frame scaled to size, taken from the camera's
+     * frame pyramid and shared with any stream of the same size, e.g. the
+     * 240x180 the GRIP pipelines resize to. Always BGR. Set before adding the
+     * consumer to the hub.
+     */
+    void SetInputSize(cv::Size size) { m_inputSize = size; }
+    cv::Size GetInputSize() const override { return m_inputSize; }
+
+    /**
+     * Name its delivery counters are published under, e.g. the pipeline's.
+     * Set before adding the consumer to the hub.
+     */
+    void SetName(const std::string& name) { m_name = name; }
+    std::string GetName() const override { return m_name; }
+
+    void OnFrame(const FramePtr& frame) override {
+        uint64_t start = wpi::Now();
+        if (m_inputSize.area() > 0) {
+            m_image = frame->Scaled(m_inputSize);
+        } else if (frame->image.type() == CV_8UC2 && !m_nativeYuyv) {
+            cv::cvtColor(frame->image, m_converted, cv::COLOR_YUV2BGR_YUYV);
+            m_image = m_converted;
+        } else {
+            // Only the header is copied, the pixels still belong to the frame
+            m_image = frame->image;
+        }
+        m_pipeline->Process(m_image);
+        if (m_listener) m_listener(*m_pipeline);
+        if (m_frameListener) m_frameListener(*m_pipeline, *frame);
+        // The pixels go back to the pool with the frame and are written over
+        // in place by the next capture, so keep no header to them
+        m_image.release();
+
+        uint64_t published = wpi::Now();
+        if (m_publish) {
+            m_captureTime.SetDouble(frame->time);
+            m_latencyEntry.SetDouble((published - frame->time) * 1.0e-6);
+            throttledFlush();
+        }
+        if (m_latency) m_latency->vision.Record(frame->time, start, published);
+    }
+
+    int GetDivider() const override { return m_divider; }
+    bool IsVision() const override { return true; }
+
+    T& GetPipeline() { return *m_pipeline; }
+
+    private:
+    std::unique_ptr<T> m_pipeline;
+    std::function<void(T&)> m_listener;
+    std::function<void(T&, const Frame&)> m_frameListener;
+    int m_divider;
+    std::string m_name;
+    cv::Mat m_image;
+    bool m_nativeYuyv = false;
+    cv::Size m_inputSize;
+    // Reused for YUYV frames converted to BGR
+    cv::Mat m_converted;
+
+    bool m_publish = false;
+    nt::NetworkTableEntry m_captureTime;
+    nt::NetworkTableEntry m_latencyEntry;
+};
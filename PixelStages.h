@@ -0,0 +1,305 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vision/VisionPipeline.h>
+
+#include "HsvThreshold.h"
+
+/**
+ * Per pixel pipeline stages that compose at compile time into a single row
+ * kernel, so a chain like GRIP's HSL threshold, mask and RGB threshold costs
+ * one pass over the image with no image in between, instead of a cvtColor,
+ * inRange or copyTo pass per step.
+ *
+ * A stage is a test of one BGR pixel. InRange<Space> is the cv::inRange of
+ * the pixel converted to Space, the others combine stages:
+ *
+ *     using namespace stages;
+ *     auto cargo = masked(InRange<Hls>(lowerHls, upperHls), InRange<Rgb>(lowerRgb, upperRgb));
+ *     threshold(blurred, mask, cargo);
+ *
+ * The whole test is one type, so the compiler inlines it into the loop of
+ * threshold(). Combinations also try their cheaper side first, which is only
+ * known from the types: an RGB range is tried before the HLS conversion is
+ * needed.
+ *
+ * The conversions give what cv::cvtColor gives for 8 bit images, hue 0-180,
+ * HSV with the tables of fusedHsvThreshold(), and bounds are InRangeBounds,
+ * rounded and emptied as cv::inRange does it, the same as fusedHsvThreshold()
+ * takes them, so the masks match the OpenCV steps they replace.
+ */
+namespace stages {
+
+    // Colour spaces, each converting a BGR pixel to the channels of the
+    // cv::cvtColor code in its name. Data is worked out once per stage.
+
+    struct Bgr {
+        static const int kCost = 0;
+        struct Data {};
+        static const Data& GetData() {
+            static const Data data;
+            return data;
+        }
+        static cv::Vec3i Convert(const Data&, int b, int g, int r) { return cv::Vec3i(b, g, r); }
+    };
+
+    struct Rgb {
+        static const int kCost = 0;
+        using Data = Bgr::Data;
+        static const Data& GetData() { return Bgr::GetData(); }
+        static cv::Vec3i Convert(const Data&, int b, int g, int r) { return cv::Vec3i(r, g, b); }
+    };
+
+    // cv::COLOR_BGR2HSV, with the same fixed point reciprocals
+    struct Hsv {
+        static const int kCost = 1;
+        using Data = HsvTables;
+        static const Data& GetData() { return HsvTables::Get(); }
+        static cv::Vec3i Convert(const Data& t, int b, int g, int r) {
+            const int kShift = HsvTables::kShift;
+            int v = std::max(b, std::max(g, r));
+            int diff = v - std::min(b, std::min(g, r));
+            int s = (diff * t.sdiv[v] + (1 << (kShift - 1))) >> kShift;
+            int h = v == r ? g - b : v == g ? b - r + 2 * diff : r - g + 4 * diff;
+            h = (h * t.hdiv[diff] + (1 << (kShift - 1))) >> kShift;
+            if (h < 0) h += 180;
+            return cv::Vec3i(h, s, v);
+        }
+    };
+
+    // cv::COLOR_BGR2HLS, which OpenCV works out in float, step for step
+    struct Hls {
+        static const int kCost = 2;
+        using Data = Bgr::Data;
+        static const Data& GetData() { return Bgr::GetData(); }
+        static cv::Vec3i Convert(const Data&, int b8, int g8, int r8) {
+            float b = b8 * (1.f / 255.f), g = g8 * (1.f / 255.f), r = r8 * (1.f / 255.f);
+            float h = 0.f, s = 0.f;
+            float vmax = std::max(r, std::max(g, b));
+            float vmin = std::min(r, std::min(g, b));
+            float diff = vmax - vmin;
+            float l = (vmax + vmin) * 0.5f;
+            if (diff > FLT_EPSILON) {
+                s = l < 0.5f ? diff / (vmax + vmin) : diff / (2 - vmax - vmin);
+                diff = 60.f / diff;
+                if (vmax == r) {
+                    h = (g - b) * diff;
+                } else if (vmax == g) {
+                    h = (b - r) * diff + 120.f;
+                } else {
+                    h = (r - g) * diff + 240.f;
+                }
+                if (h < 0.f) h += 360.f;
+            }
+            return cv::Vec3i(cv::saturate_cast<uint8_t>(h * 0.5f), cv::saturate_cast<uint8_t>(l * 255.f),
+                             cv::saturate_cast<uint8_t>(s * 255.f));
+        }
+    };
+
+    /**
+     * The pixel converted to Space is inside [lower, upper] in every channel.
+     */
+    template <typename Space>
+    class InRange {
+        public:
+        static const int kCost = Space::kCost;
+
+        InRange(const cv::Scalar& lower, const cv::Scalar& upper) : m_data(Space::GetData()) {
+            for (int i = 0; i < 3; ++i) {
+                InRangeBounds bounds(lower[i], upper[i]);
+                m_lower[i] = bounds.lo;
+                m_upper[i] = bounds.hi;
+            }
+        }
+
+        bool operator()(int b, int g, int r) const {
+            cv::Vec3i c = Space::Convert(m_data, b, g, r);
+            return c[0] >= m_lower[0] && c[0] <= m_upper[0] && c[1] >= m_lower[1] && c[1] <= m_upper[1] &&
+                   c[2] >= m_lower[2] && c[2] <= m_upper[2];
+        }
+
+        private:
+        const typename Space::Data& m_data;
+        int m_lower[3];
+        int m_upper[3];
+    };
+
+    /**
+     * Both stages pass.
+     */
+    template <typename A, typename B>
+    class Both {
+        public:
+        static const int kCost = A::kCost + B::kCost;
+
+        Both(const A& a, const B& b) : m_a(a), m_b(b) {}
+
+        bool operator()(int b, int g, int r) const {
+            if (A::kCost <= B::kCost) return m_a(b, g, r) && m_b(b, g, r);
+            return m_b(b, g, r) && m_a(b, g, r);
+        }
+
+        private:
+        A m_a;
+        B m_b;
+    };
+
+    /**
+     * Either stage passes.
+     */
+    template <typename A, typename B>
+    class Either {
+        public:
+        static const int kCost = A::kCost + B::kCost;
+
+        Either(const A& a, const B& b) : m_a(a), m_b(b) {}
+
+        bool operator()(int b, int g, int r) const {
+            if (A::kCost <= B::kCost) return m_a(b, g, r) || m_b(b, g, r);
+            return m_b(b, g, r) || m_a(b, g, r);
+        }
+
+        private:
+        A m_a;
+        B m_b;
+    };
+
+    /**
+     * The stage fails.
+     */
+    template <typename A>
+    class Invert {
+        public:
+        static const int kCost = A::kCost;
+
+        explicit Invert(const A& a) : m_a(a) {}
+
+        bool operator()(int b, int g, int r) const { return !m_a(b, g, r); }
+
+        private:
+        A m_a;
+    };
+
+    /**
+     * test on the image blacked out where mask fails, GRIP's mask step
+     * followed by test. Just Both when black fails test, as it usually does.
+     */
+    template <typename Mask, typename Test>
+    class Masked {
+        public:
+        static const int kCost = Mask::kCost + Test::kCost;
+
+        Masked(const Mask& mask, const Test& test) : m_mask(mask), m_test(test), m_black(test(0, 0, 0)) {}
+
+        bool operator()(int b, int g, int r) const {
+            if (m_black) return !m_mask(b, g, r) || m_test(b, g, r);
+            if (Test::kCost <= Mask::kCost) return m_test(b, g, r) && m_mask(b, g, r);
+            return m_mask(b, g, r) && m_test(b, g, r);
+        }
+
+        private:
+        Mask m_mask;
+        Test m_test;
+        bool m_black;
+    };
+
+    template <typename A, typename B>
+    Both<A, B> both(const A& a, const B& b) {
+        return Both<A, B>(a, b);
+    }
+
+    template <typename A, typename B>
+    Either<A, B> either(const A& a, const B& b) {
+        return Either<A, B>(a, b);
+    }
+
+    template <typename A>
+    Invert<A> invert(const A& a) {
+        return Invert<A>(a);
+    }
+
+    template <typename Mask, typename Test>
+    Masked<Mask, Test> masked(const Mask& mask, const Test& test) {
+        return Masked<Mask, Test>(mask, test);
+    }
+
+    /**
+     * mask (CV_8UC1) is 255 where the pixel of bgr (CV_8UC3) passes test, 0
+     * elsewhere.
+     */
+    template <typename Test>
+    void threshold(const cv::Mat& bgr, cv::Mat& mask, const Test& test) {
+        CV_Assert(bgr.type() == CV_8UC3);
+        mask.create(bgr.size(), CV_8UC1);
+        for (int y = 0; y < bgr.rows; ++y) {
+            const uint8_t* p = bgr.ptr<uint8_t>(y);
+            uint8_t* out = mask.ptr<uint8_t>(y);
+            for (int x = 0; x < bgr.cols; ++x, p += 3) out[x] = test(p[0], p[1], p[2]) ? 255 : 0;
+        }
+    }
+
+    /**
+     * dst is bgr blacked out where test fails.
+     */
+    template <typename Test>
+    void applyMask(const cv::Mat& bgr, cv::Mat& dst, const Test& test) {
+        CV_Assert(bgr.type() == CV_8UC3);
+        dst.create(bgr.size(), CV_8UC3);
+        for (int y = 0; y < bgr.rows; ++y) {
+            const uint8_t* p = bgr.ptr<uint8_t>(y);
+            uint8_t* out = dst.ptr<uint8_t>(y);
+            for (int x = 0; x < 3 * bgr.cols; x += 3) {
+                bool pass = test(p[x], p[x + 1], p[x + 2]);
+                out[x] = pass ? p[x] : 0;
+                out[x + 1] = pass ? p[x + 1] : 0;
+                out[x + 2] = pass ? p[x + 2] : 0;
+            }
+        }
+    }
+
+    /**
+     * The GRIP resize, box blur and threshold pipeline with the thresholding
+     * steps fused into test, for frc::VisionRunner or a PipelineConsumer. The
+     * resize is skipped when the frame already has the size, e.g. from a
+     * PipelineConsumer's input size.
+     */
+    template <typename Test>
+    class FusedPipeline : public frc::VisionPipeline {
+        public:
+        FusedPipeline(cv::Size size, double blurRadius, const Test& test, int interpolation = cv::INTER_AREA)
+            : m_size(size), m_blurRadius(static_cast<int>(blurRadius + 0.5)), m_test(test),
+              m_interpolation(interpolation) {}
+
+        void Process(cv::Mat& mat) override {
+            cv::Mat image = mat;
+            if (m_size.area() > 0 && image.size() != m_size) {
+                cv::resize(image, m_resized, m_size, 0, 0, m_interpolation);
+                image = m_resized;
+            }
+            if (m_blurRadius > 0) {
+                int size = 2 * m_blurRadius + 1;
+                cv::blur(image, m_blurred, cv::Size(size, size));
+                image = m_blurred;
+            }
+            threshold(image, m_output, m_test);
+        }
+
+        cv::Mat* GetOutput() { return &m_output; }
+
+        const Test& GetTest() const { return m_test; }
+
+        private:
+        cv::Size m_size;
+        int m_blurRadius;
+        Test m_test;
+        int m_interpolation;
+        cv::Mat m_resized;
+        cv::Mat m_blurred;
+        cv::Mat m_output;
+    };
+}  // namespace stages
@@ -0,0 +1,166 @@
+/*
+   Checks that the fused cargo pipeline of PixelStages.h gives the same mask
+   as the GRIP pipeline it replaces, and times both. Built with "make bench",
+   run on the Pi:
+
+       ./pixelStagesBench [image ...]
+
+   Without images it makes up camera frames with cargo coloured discs on
+   noise. Prints whether the fused pipeline is at least 3x faster than
+   GripCargoPipeline, and exits 1 if any mask differs.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "HsvThreshold.h"
+#include "archive/FusedCargoPipeline.h"
+#include "archive/GripCargoPipeline.h"
+
+namespace {
+
+    const int kRuns = 200;
+    // What the fused pipeline has to gain over GripCargoPipeline::Process
+    const double kTargetSpeedup = 3;
+
+    // Pixels where a and b differ
+    int Mismatches(const cv::Mat& a, const cv::Mat& b) {
+        if (a.size() != b.size() || a.type() != b.type()) return a.rows * a.cols + b.rows * b.cols;
+        cv::Mat diff;
+        cv::compare(a, b, diff, cv::CMP_NE);
+        return cv::countNonZero(diff);
+    }
+
+    // A 4096x4096 image holding every 8 bit BGR colour once
+    cv::Mat AllColors() {
+        cv::Mat image(4096, 4096, CV_8UC3);
+        for (int y = 0; y < image.rows; ++y) {
+            uint8_t* p = image.ptr<uint8_t>(y);
+            for (int x = 0; x < image.cols; ++x, p += 3) {
+                uint32_t color = static_cast<uint32_t>(y) << 12 | static_cast<uint32_t>(x);
+                p[0] = color & 0xff;
+                p[1] = (color >> 8) & 0xff;
+                p[2] = (color >> 16) & 0xff;
+            }
+        }
+        return image;
+    }
+
+    // GRIP's HSL threshold, mask and RGB threshold steps of the cargo
+    // pipeline on image, done with OpenCV as GripCargoPipeline does them
+    void GripSteps(const cv::Mat& image, cv::Mat& mask) {
+        cv::Mat hls, masked, rgb;
+        cv::cvtColor(image, hls, cv::COLOR_BGR2HLS);
+        cv::inRange(hls, cv::Scalar(0.0, 98.60611510791367, 188.03956834532374),
+                    cv::Scalar(50.98976109215017, 204.95733788395904, 255.0), mask);
+        masked = cv::Mat::zeros(image.size(), image.type());
+        image.copyTo(masked, mask);
+        cv::cvtColor(masked, rgb, cv::COLOR_BGR2RGB);
+        cv::inRange(rgb, cv::Scalar(206.38489208633092, 64.20863309352518, 11.465827338129495),
+                    cv::Scalar(255.0, 215.83617747440275, 141.86006825938566), mask);
+    }
+
+    std::vector<cv::Mat> MakeFrames() {
+        std::vector<cv::Mat> frames;
+        cv::RNG rng(2019);
+        for (int i = 0; i < 8; ++i) {
+            cv::Mat frame(480, 640, CV_8UC3);
+            rng.fill(frame, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+            for (int k = 0; k < 3; ++k) {
+                cv::Point center(rng.uniform(0, frame.cols), rng.uniform(0, frame.rows));
+                cv::Scalar cargo(rng.uniform(20, 90), rng.uniform(110, 180), rng.uniform(230, 256));
+                cv::circle(frame, center, rng.uniform(20, 120), cargo, -1);
+            }
+            frames.push_back(frame);
+        }
+        return frames;
+    }
+
+    template <typename Pipeline, typename Output>
+    double Time(Pipeline& pipeline, std::vector<cv::Mat>& frames, Output output, std::vector<cv::Mat>& masks) {
+        masks.clear();
+        // Warm up, and keep the masks of one pass over the frames
+        for (auto& frame : frames) {
+            pipeline.Process(frame);
+            masks.push_back((pipeline.*output)()->clone());
+        }
+        int64_t start = cv::getTickCount();
+        for (int i = 0; i < kRuns; ++i) pipeline.Process(frames[i % frames.size()]);
+        return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() / kRuns;
+    }
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    bool same = true;
+
+    // Every colour, so the fused test is checked against the OpenCV steps
+    // for all inputs rather than just those in the frames
+    cv::Mat colors = AllColors();
+    cv::Mat expected, actual;
+    GripSteps(colors, expected);
+    std::unique_ptr<cargoGrip::FusedCargoPipeline> fused(cargoGrip::NewFusedCargoPipeline());
+    stages::threshold(colors, actual, fused->GetTest());
+    int mismatches = Mismatches(expected, actual);
+    std::printf("all colours: %d of %d differ\n", mismatches, colors.rows * colors.cols);
+    if (mismatches != 0) same = false;
+
+    // Bounds as cv::inRange takes them: fractions, crossing and outside
+    // 0-255, tested on the image itself so only the bounds can differ, then
+    // in HSV through InRange<Hsv> and fusedHsvThreshold
+    const cv::Scalar bounds[][2] = {{cv::Scalar(10, 100, 50), cv::Scalar(40, 255, 255)},
+                                    {cv::Scalar(10.5, 99.5, 49.4), cv::Scalar(40.5, 254.5, 254.6)},
+                                    {cv::Scalar(-20, -5, 240), cv::Scalar(-1, 300, 400)},
+                                    {cv::Scalar(256, 0, 0), cv::Scalar(300, 255, 255)},
+                                    {cv::Scalar(-20, 0, 0), cv::Scalar(20, 255, 300)},
+                                    {cv::Scalar(90, 0, 0), cv::Scalar(30, 255, 255)}};
+    cv::Mat hsv;
+    cv::cvtColor(colors, hsv, cv::COLOR_BGR2HSV);
+    for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); ++i) {
+        const cv::Scalar& lower = bounds[i][0];
+        const cv::Scalar& upper = bounds[i][1];
+        cv::inRange(colors, lower, upper, expected);
+        stages::threshold(colors, actual, stages::InRange<stages::Bgr>(lower, upper));
+        int bgr = Mismatches(expected, actual);
+
+        cv::inRange(hsv, lower, upper, expected);
+        stages::threshold(colors, actual, stages::InRange<stages::Hsv>(lower, upper));
+        int stage = Mismatches(expected, actual);
+        double hue[2] = {lower[0], upper[0]}, sat[2] = {lower[1], upper[1]}, val[2] = {lower[2], upper[2]};
+        fusedHsvThreshold(colors, hue, sat, val, actual);
+        int fusedHsv = Mismatches(expected, actual);
+
+        std::printf("bounds %zu: %d bgr, %d hsv stage, %d fusedHsvThreshold differ\n", i, bgr, stage, fusedHsv);
+        if (bgr != 0 || stage != 0 || fusedHsv != 0) same = false;
+    }
+
+    std::vector<cv::Mat> frames;
+    for (int i = 1; i < argc; ++i) {
+        cv::Mat frame = cv::imread(argv[i]);
+        if (frame.empty()) {
+            std::fprintf(stderr, "could not read %s\n", argv[i]);
+            return 2;
+        }
+        frames.push_back(frame);
+    }
+    if (frames.empty()) frames = MakeFrames();
+
+    cargoGrip::GripCargoPipeline grip;
+    std::vector<cv::Mat> gripMasks, fusedMasks;
+    double gripTime = Time(grip, frames, &cargoGrip::GripCargoPipeline::GetRgbThresholdOutput, gripMasks);
+    double fusedTime = Time(*fused, frames, &cargoGrip::FusedCargoPipeline::GetOutput, fusedMasks);
+    mismatches = 0;
+    for (size_t i = 0; i < frames.size(); ++i) mismatches += Mismatches(gripMasks[i], fusedMasks[i]);
+    std::printf("frames: %d pixels differ in %zu frames\n", mismatches, frames.size());
+    if (mismatches != 0) same = false;
+
+    double speedup = gripTime / fusedTime;
+    std::printf("grip %.3f ms, fused %.3f ms per frame, %.2fx (%s %.0fx)\n", gripTime, fusedTime, speedup,
+                speedup >= kTargetSpeedup ? "meets" : "below", kTargetSpeedup);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+#include "Scheduler.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+namespace {
+    // Do not change the slowdown more often than this, so a change has time
+    // to show up in the latency before the next one (microseconds)
+    const uint64_t kChangeInterval = 250000;
+    // Speed the streams back up after this long without a miss
+    const uint64_t kRecoverInterval = 2000000;
+}  // namespace
+
+Scheduler& Scheduler::GetInstance() {
+    static Scheduler instance;
+    return instance;
+}
+
+void Scheduler::ApplyToCurrentThread(const std::string& name, const TaskPolicy& policy) {
+    if (policy.realtimePriority > 0) {
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = policy.realtimePriority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err == 0) return;
+        wpi::errs() << "scheduler: '" << name << "' could not use SCHED_FIFO ("
+        << std::strerror(err) << "), using nice " << policy.nice << " instead\n";
+    }
+
+    if (policy.nice != 0) {
+        // On Linux the nice value is per thread
+        if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), policy.nice) != 0) {
+            wpi::errs() << "scheduler: '" << name << "' could not set nice "
+            << policy.nice << " (" << std::strerror(errno) << ")\n";
+        }
+    }
+}
+
+void Scheduler::ReportVisionLatency(const std::string& name, double latency, double deadline) {
+    if (deadline <= 0.0) return;
+    uint64_t now = wpi::Now();
+
+    if (latency > deadline) {
+        m_missed.fetch_add(1, std::memory_order_relaxed);
+        m_lastMiss.store(now, std::memory_order_relaxed);
+        uint64_t last = m_lastChange.load(std::memory_order_relaxed);
+        int slowdown = m_slowdown.load(std::memory_order_relaxed);
+        if (slowdown < kMaxSlowdown && now - last > kChangeInterval &&
+            m_lastChange.compare_exchange_strong(last, now)) {
+            m_slowdown.store(slowdown * 2, std::memory_order_relaxed);
+            wpi::outs() << "scheduler: '" << name << "' missed its deadline ("
+            << int(latency * 1000) << " ms), streams now send 1 in " << slowdown * 2 << " frames\n";
+        }
+        return;
+    }
+
+    Recover(now);
+}
+
+void Scheduler::Recover(uint64_t now) {
+    // Back off one step at a time once nothing has missed for a while
+    uint64_t last = m_lastChange.load(std::memory_order_relaxed);
+    int slowdown = m_slowdown.load(std::memory_order_relaxed);
+    if (slowdown > 1 && now - m_lastMiss.load(std::memory_order_relaxed) > kRecoverInterval &&
+        now - last > kRecoverInterval && m_lastChange.compare_exchange_strong(last, now)) {
+        m_slowdown.store(slowdown / 2, std::memory_order_relaxed);
+    }
+}
+
+void Scheduler::Publish() {
+    // Without vision reports, e.g. after the last pipeline was removed, this
+    // is what brings the streams back up
+    Recover(wpi::Now());
+    if (!m_table) m_table = nt::NetworkTableInstance::GetDefault().GetTable("CameraScheduler");
+    m_table->PutNumber("missed deadlines", GetMissedDeadlines());
+    m_table->PutNumber("stream slowdown", GetStreamSlowdown());
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <networktables/NetworkTable.h>
+
+/**
+ * How the threads of one kind of task should be scheduled.
+ */
+struct TaskPolicy {
+    // SCHED_FIFO priority (1-99), 0 keeps the normal time sharing scheduler
+    int realtimePriority = 0;
+    // Nice value used when not real time (or when real time is not allowed)
+    int nice = 0;
+    // Latency deadline from capture to result in seconds, 0 for none
+    double deadline = 0.0;
+
+    bool operator==(const TaskPolicy& other) const {
+        return realtimePriority == other.realtimePriority && nice == other.nice && deadline == other.deadline;
+    }
+    bool operator!=(const TaskPolicy& other) const { return !(*this == other); }
+};
+
+/**
+ * Scheduling for the threads of one camera. Vision pipelines get the vision
+ * policy, dashboard streams the stream policy. These come from the optional
+ * "schedule" object of a camera in /boot/frc.json.
+ */
+struct SchedulePolicy {
+    TaskPolicy vision;
+    TaskPolicy stream;
+
+    bool operator==(const SchedulePolicy& other) const { return vision == other.vision && stream == other.stream; }
+    bool operator!=(const SchedulePolicy& other) const { return !(*this == other); }
+};
+
+/**
+ * Shares the Pi between vision pipelines and dashboard streams.
+ *
+ * Vision threads can be made real time or given a better nice value so they
+ * win over the streams. When a pipeline misses its deadline the streams are
+ * slowed down by sending fewer frames, and brought back up again once no
+ * pipeline has missed for a while, whether or not any pipeline is still
+ * running.
+ */
+class Scheduler {
+    public:
+    static Scheduler& GetInstance();
+
+    /**
+     * Apply a policy to the calling thread.
+     */
+    void ApplyToCurrentThread(const std::string& name, const TaskPolicy& policy);
+
+    /**
+     * Report how long a vision result took from capture. Counts as a miss if
+     * it was over the deadline.
+     */
+    void ReportVisionLatency(const std::string& name, double latency, double deadline);
+
+    /**
+     * Streams should only send every nth frame they would otherwise send.
+     */
+    int GetStreamSlowdown() const { return m_slowdown.load(std::memory_order_relaxed); }
+
+    /**
+     * Total number of vision deadline misses.
+     */
+    uint64_t GetMissedDeadlines() const { return m_missed.load(std::memory_order_relaxed); }
+
+    /**
+     * Speed the streams back up if nothing missed for a while, even with no
+     * pipeline left to report, and put the misses and the slowdown in
+     * NetworkTables under CameraScheduler. Call about once a second.
+     */
+    void Publish();
+
+    private:
+    Scheduler() = default;
+
+    // Halve the slowdown if nothing missed for a while
+    void Recover(uint64_t now);
+
+    static constexpr int kMaxSlowdown = 8;
+
+    std::atomic<int> m_slowdown{1};
+    std::atomic<uint64_t> m_missed{0};
+    // wpi::Now() of the last slowdown change and of the last miss
+    std::atomic<uint64_t> m_lastChange{0};
+    std::atomic<uint64_t> m_lastMiss{0};
+    std::shared_ptr<nt::NetworkTable> m_table;
+};
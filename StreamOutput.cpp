@@ -0,0 +1,170 @@
+#include "StreamOutput.h"
+
+#include <algorithm>
+
+#include <networktables/NetworkTableInstance.h>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <wpi/timestamp.h>
+
+#include "cameraserver/CameraServer.h"
+#include "Scheduler.h"
+
+namespace {
+
+    // Cropping needs the full frame, anything else can start from the pyramid
+    cv::Size InputSize(const OutputStage& stage) {
+        return stage.GetCrop().area() > 0 ? cv::Size() : stage.GetSize();
+    }
+}  // namespace
+
+StreamOutput::StreamOutput(const std::string& name, int width, int height, int frameRateDivider,
+                           const cv::Rect& crop, const std::vector<Overlay>& overlays)
+    : m_name(name), m_frameRateDivider(frameRateDivider < 1 ? 1 : frameRateDivider),
+      m_size(width, height), m_crop(crop), m_overlays(overlays) {
+    // Setup a CvSource. This will send images back to the Dashboard
+    auto inst = frc::CameraServer::GetInstance();
+    m_svr = inst->PutVideo(name, width, height);
+    m_server = inst->GetServer("serve_" + name);
+    m_grayProperty = m_svr.CreateBooleanProperty("gray", false, false);
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    BuildStage();
+}
+
+void StreamOutput::OnFrame(const FramePtr& frame) {
+    // Give the CPU to vision while it is missing deadlines, and the bandwidth
+    // to other streams if the governor says so
+    int slowdown = Scheduler::GetInstance().GetStreamSlowdown() * m_skip;
+    m_counter = (m_counter + 1) % slowdown;
+    if (m_counter) return;
+    uint64_t start = wpi::Now();
+    std::shared_ptr<OutputStage> stage = std::atomic_load(&m_stage);
+    bool gray = m_grayProperty.Get() != 0;
+    if (gray != stage->IsGray()) {
+        // Switched from the dashboard or by SetGray()
+        std::lock_guard<std::mutex> lock(m_layoutMutex);
+        m_gray = gray;
+        BuildStage();
+        stage = std::atomic_load(&m_stage);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_targetMutex);
+        m_frameTargets = m_targets;
+    }
+    if (m_skipStatic) {
+        // Checked on the camera frame, so nothing is scaled for a frame that
+        // is not sent. New targets or a new layout always count as a change.
+        bool changed = m_detector.Changed(frame->image) || m_frameTargets != m_sentTargets ||
+                       stage != m_sentStage || start - m_lastSent >= m_keepAlive * 1000ull;
+        uint64_t checked = wpi::Now();
+        m_checkTime.fetch_add(checked - start, std::memory_order_relaxed);
+        if (!changed) {
+            m_framesSkipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        m_detector.Accept();
+        m_sentTargets = m_frameTargets;
+        m_sentStage = stage;
+        m_lastSent = start;
+        start = checked;
+    }
+    // Gray from a raw camera comes straight from the Y plane, the pyramid
+    // would convert it to BGR first
+    cv::Mat input = stage->IsGray() && frame->image.type() == CV_8UC2 ? frame->image : frame->Scaled(InputSize(*stage));
+    if (input.size() != frame->image.size()) {
+        // Targets are in camera pixels
+        double sx = static_cast<double>(input.cols) / frame->image.cols;
+        double sy = static_cast<double>(input.rows) / frame->image.rows;
+        for (auto& target : m_frameTargets) {
+            target = cv::Rect(cvRound(target.x * sx), cvRound(target.y * sy),
+                              cvRound(target.width * sx), cvRound(target.height * sy));
+        }
+    }
+    // Only the header is copied
+    cv::Mat image = stage->Render(input, m_frameTargets);
+    m_svr.PutFrame(image);
+    uint64_t end = wpi::Now();
+    if (m_latency) m_latency->stream.Record(frame->time, start, end);
+
+    m_sent.fetch_add(1, std::memory_order_relaxed);
+    m_framesSent.fetch_add(1, std::memory_order_relaxed);
+    m_sendTime.fetch_add(end - start, std::memory_order_relaxed);
+    if (m_measure.exchange(false)) {
+        // What the server will make of it, cscore uses 80 unless told otherwise
+        int quality = m_quality;
+        std::vector<int> params{cv::IMWRITE_JPEG_QUALITY, quality < 0 ? 80 : quality};
+        if (cv::imencode(".jpg", image, m_jpeg, params)) m_jpegSize = m_jpeg.size();
+    }
+}
+
+cv::Size StreamOutput::GetInputSize() const {
+    return InputSize(*std::atomic_load(&m_stage));
+}
+
+void StreamOutput::SetLayout(int width, int height, const cv::Rect& crop, const std::vector<Overlay>& overlays) {
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    m_size = cv::Size(width, height);
+    m_crop = crop;
+    m_overlays = overlays;
+    BuildStage();
+}
+
+void StreamOutput::SetReduction(int quality, int skip, int shift) {
+    m_quality = quality;
+    m_skip = skip < 1 ? 1 : skip;
+    m_server.GetProperty("compression").Set(quality);
+
+    std::lock_guard<std::mutex> lock(m_layoutMutex);
+    if (shift == m_shift) return;
+    m_shift = shift;
+    BuildStage();
+}
+
+double StreamOutput::TakeByteRate(double seconds) {
+    uint64_t sent = m_sent.exchange(0, std::memory_order_relaxed);
+    m_measure = true;
+    if (seconds <= 0) return 0.0;
+    return sent * static_cast<double>(m_jpegSize) / seconds;
+}
+
+void StreamOutput::Publish() {
+    uint64_t now = wpi::Now();
+    double seconds = m_lastPublish != 0 ? (now - m_lastPublish) * 1.0e-6 : 0.0;
+    m_lastPublish = now;
+    uint64_t sent = m_framesSent.exchange(0, std::memory_order_relaxed);
+    uint64_t skipped = m_framesSkipped.exchange(0, std::memory_order_relaxed);
+    uint64_t sendTime = m_sendTime.exchange(0, std::memory_order_relaxed);
+    uint64_t checkTime = m_checkTime.exchange(0, std::memory_order_relaxed);
+    if (seconds <= 0) return;
+
+    // A skipped frame would have cost as much to scale and send as the ones
+    // that were, less what checking all of them cost. The JPEG encoding in
+    // the server comes on top of that.
+    double saved = sent > 0 ? skipped * static_cast<double>(sendTime) / sent : 0.0;
+    saved -= checkTime;
+
+    if (!m_table) m_table = nt::NetworkTableInstance::GetDefault().GetTable("CameraStreams")->GetSubTable(m_name);
+    m_table->PutNumber("fps", sent / seconds);
+    m_table->PutNumber("skip ratio", sent + skipped > 0 ? static_cast<double>(skipped) / (sent + skipped) : 0.0);
+    // Milliseconds of CPU per second
+    m_table->PutNumber("cpu saved", saved * 1.0e-3 / seconds);
+}
+
+void StreamOutput::BuildStage() {
+    // Halving keeps 2:1 and 4:1 outputs on the boxDownscale() fast path. The
+    // overlays are rasterised here rather than on the output thread.
+    cv::Size size(std::max(1, m_size.width >> m_shift), std::max(1, m_size.height >> m_shift));
+    std::vector<Overlay> overlays;
+    for (auto& overlay : m_overlays) overlays.push_back(overlay.Scaled(1.0 / (1 << m_shift)));
+    std::atomic_store(&m_stage, std::make_shared<OutputStage>(size, m_crop, overlays, m_gray));
+    m_svr.SetResolution(size.width, size.height);
+}
+
+void StreamOutput::SetTargets(const std::vector<cv::Rect>& targets) {
+    std::lock_guard<std::mutex> lock(m_targetMutex);
+    m_targets = targets;
+}
+
+void StreamOutput::OnError(const std::string& message) {
+    // Send error to the output
+    m_svr.NotifyError(message);
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <cscore.h>
+#include <networktables/NetworkTable.h>
+#include <opencv2/core/core.hpp>
+
+#include "ChangeDetector.h"
+#include "FrameHub.h"
+#include "OutputStage.h"
+
+/**
+ * Sends camera frames back to the dashboard at a reduced size and rate, going
+ * through an OutputStage to crop them and draw overlays. When the Scheduler
+ * asks streams to slow down for vision, only every nth frame received is sent.
+ * The BandwidthGovernor can turn the stream down further with
+ * SetReduction().
+ *
+ * The stream has a "gray" property, which the dashboard can set through
+ * the CameraPublisher table like any camera property, to send luma only.
+ *
+ * With SetSkipStatic() frames that look the same as the last one sent are
+ * dropped before they are scaled or sent, e.g. while the robot sits
+ * disabled in front of a wall.
+ */
+class StreamOutput : public FrameConsumer {
+    public:
+    StreamOutput(const std::string& name, int width, int height, int frameRateDivider,
+                 const cv::Rect& crop = cv::Rect(), const std::vector<Overlay>& overlays = std::vector<Overlay>());
+
+    void OnFrame(const FramePtr& frame) override;
+    void OnError(const std::string& message) override;
+    int GetDivider() const override { return m_frameRateDivider; }
+
+    /**
+     * Only active while a dashboard is streaming it.
+     */
+    bool IsActive() const override { return m_svr.IsEnabled(); }
+
+    /**
+     * The output size, taken from the frame pyramid, unless the stream is
+     * cropped and needs the full frame.
+     */
+    cv::Size GetInputSize() const override;
+
+    /**
+     * Change the output size, crop and overlays, taking effect from the next
+     * frame.
+     */
+    void SetLayout(int width, int height, const cv::Rect& crop, const std::vector<Overlay>& overlays);
+
+    /**
+     * Boxes, in camera pixels, to draw on the following frames, e.g. the
+     * targets found by a vision pipeline. Only drawn if the overlays include
+     * Overlay::kTargets.
+     */
+    void SetTargets(const std::vector<cv::Rect>& targets);
+
+    /**
+     * Change the divider. Call FrameHub::ConsumersChanged() afterwards.
+     */
+    void SetDivider(int frameRateDivider) { m_frameRateDivider = frameRateDivider < 1 ? 1 : frameRateDivider; }
+
+    /**
+     * Send CV_8UC1 frames, encoded as single component JPEGs, from the next
+     * frame. Sets the "gray" property, so the dashboard sees the change.
+     */
+    void SetGray(bool gray) { m_grayProperty.Set(gray); }
+
+    /**
+     * Streams with a higher priority keep their bandwidth longer when the
+     * BandwidthGovernor has to cut back.
+     */
+    void SetPriority(int priority) { m_priority = priority; }
+    int GetPriority() const { return m_priority; }
+
+    /**
+     * Turn the stream down from its configured settings: JPEG quality (-1 for
+     * the server default), only sending every skip-th frame and dividing the
+     * resolution by 2^shift.
+     */
+    void SetReduction(int quality, int skip, int shift);
+
+    /**
+     * Only send frames that changed, and one every keepAlive ms so the
+     * dashboard does not think the stream died.
+     */
+    void SetSkipStatic(bool enabled, int keepAlive) {
+        m_skipStatic = enabled;
+        m_keepAlive = keepAlive < 0 ? 0 : keepAlive;
+    }
+
+    /**
+     * Put the frames sent per second, the fraction of frames skipped as
+     * unchanged and the CPU time that saved in NetworkTables, under
+     * CameraStreams/<name>. Called about once a second.
+     */
+    void Publish();
+
+    /**
+     * Estimated bytes per second sent to the dashboard over the last seconds:
+     * the JPEG size of a recent frame times the frames sent. Resets the
+     * frame count and asks for a new frame to be measured.
+     */
+    double TakeByteRate(double seconds);
+
+    std::string GetName() const override { return m_name; }
+    cs::CvSource& GetSource() { return m_svr; }
+
+    private:
+    // Called with m_layoutMutex held
+    void BuildStage();
+
+    std::string m_name;
+    std::atomic<int> m_frameRateDivider;
+    cs::CvSource m_svr;
+    cs::VideoSink m_server;
+    cs::VideoProperty m_grayProperty;
+    // Replaced as a whole by BuildStage(), use std::atomic_load/store
+    std::shared_ptr<OutputStage> m_stage;
+
+    // Configured layout and the governor's resolution shift
+    std::mutex m_layoutMutex;
+    cv::Size m_size;
+    cv::Rect m_crop;
+    std::vector<Overlay> m_overlays;
+    bool m_gray = false;
+    int m_shift = 0;
+
+    std::atomic<int> m_priority{0};
+    std::atomic<int> m_quality{-1};
+    std::atomic<int> m_skip{1};
+    // Bandwidth measurement, see TakeByteRate()
+    std::atomic<uint64_t> m_sent{0};
+    std::atomic<size_t> m_jpegSize{0};
+    std::atomic_bool m_measure{true};
+    std::vector<uint8_t> m_jpeg;
+
+    // Static scene suppression, the detector and everything below it up to
+    // the statistics are only used by the output thread
+    std::atomic_bool m_skipStatic{false};
+    std::atomic<int> m_keepAlive{1000};
+    ChangeDetector m_detector;
+    std::vector<cv::Rect> m_sentTargets;
+    std::shared_ptr<OutputStage> m_sentStage;
+    uint64_t m_lastSent = 0;
+    // Since the last Publish(), times in microseconds
+    std::atomic<uint64_t> m_framesSent{0};
+    std::atomic<uint64_t> m_framesSkipped{0};
+    std::atomic<uint64_t> m_sendTime{0};
+    std::atomic<uint64_t> m_checkTime{0};
+    uint64_t m_lastPublish = 0;
+    std::shared_ptr<nt::NetworkTable> m_table;
+
+    std::mutex m_targetMutex;
+    std::vector<cv::Rect> m_targets;
+    // Copy of m_targets owned by the output thread
+    std::vector<cv::Rect> m_frameTargets;
+    // Counts frames skipped for the scheduler and the governor
+    int m_counter = 0;
+};
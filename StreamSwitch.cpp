@@ -0,0 +1,69 @@
+#include "StreamSwitch.h"
+
+#include <algorithm>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/raw_ostream.h>
+
+#include "cameraserver/CameraServer.h"
+
+StreamSwitch::StreamSwitch(const std::string& name, int port, const std::string& camera)
+    : m_name(name), m_selected(camera) {
+    auto inst = frc::CameraServer::GetInstance();
+    m_server = port > 0 ? inst->AddServer(name, port) : inst->AddServer(name);
+
+    auto table = nt::NetworkTableInstance::GetDefault().GetTable("CameraSwitch")->GetSubTable(name);
+    m_selectedEntry = table->GetEntry("selected");
+    m_camerasEntry = table->GetEntry("cameras");
+    // Whatever the robot code or dashboard already picked wins
+    if (!camera.empty()) m_selectedEntry.SetDefaultString(camera);
+    m_owner = std::make_shared<Owner>();
+    m_owner->stream = this;
+    std::shared_ptr<Owner> owner = m_owner;
+    m_listener = m_selectedEntry.AddListener([owner](const nt::EntryNotification& event) {
+        std::lock_guard<std::mutex> lock(owner->mutex);
+        if (owner->stream && event.value && event.value->IsString()) owner->stream->Select(event.value->GetString());
+    }, NT_NOTIFY_IMMEDIATE | NT_NOTIFY_NEW | NT_NOTIFY_UPDATE);
+}
+
+StreamSwitch::~StreamSwitch() {
+    {
+        // RemoveListener() does not wait for a callback already running,
+        // this does
+        std::lock_guard<std::mutex> lock(m_owner->mutex);
+        m_owner->stream = nullptr;
+    }
+    m_selectedEntry.RemoveListener(m_listener);
+    frc::CameraServer::GetInstance()->RemoveServer(m_name);
+}
+
+void StreamSwitch::SetSources(const std::vector<std::pair<std::string, cs::VideoSource>>& sources) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sources = sources;
+    std::vector<std::string> names;
+    for (auto& source : m_sources) names.push_back(source.first);
+    m_camerasEntry.SetStringArray(names);
+    Apply();
+}
+
+void StreamSwitch::Select(const std::string& camera) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_selected = camera;
+    Apply();
+}
+
+void StreamSwitch::Apply() {
+    auto it = std::find_if(m_sources.begin(), m_sources.end(),
+        [&](const std::pair<std::string, cs::VideoSource>& s) { return s.first == m_selected; });
+    cs::VideoSource current = m_server.GetSource();
+    if (it == m_sources.end()) {
+        // Keep showing a camera that is still there, otherwise the first one
+        it = std::find_if(m_sources.begin(), m_sources.end(),
+            [&](const std::pair<std::string, cs::VideoSource>& s) { return s.second == current; });
+        if (it == m_sources.end()) it = m_sources.begin();
+        if (it == m_sources.end()) return;
+    }
+    if (!it->second || it->second == current) return;
+    wpi::outs() << "switch '" << m_name << "': showing camera '" << it->first << "'\n";
+    m_server.SetSource(it->second);
+}
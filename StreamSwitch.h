@@ -0,0 +1,73 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <cscore.h>
+#include <networktables/NetworkTableEntry.h>
+
+/**
+ * One dashboard stream that shows whichever camera is selected, for drivers
+ * who only look at one camera at a time.
+ *
+ * The stream is an MjpegServer that is pointed at the selected camera's
+ * dashboard source. cscore swaps the source between two frames and the
+ * dashboard keeps its connection. Nothing watches the other sources through
+ * the switch, so their hubs stop decoding while the cameras stay open and
+ * streaming (see FrameHub). Switching to one of them only waits for its next
+ * frame.
+ *
+ * The camera is picked with the CameraSwitch/<name>/selected string in
+ * NetworkTables, CameraSwitch/<name>/cameras lists the choices. cscore gives
+ * no way to add HTTP requests to its servers, so there is no HTTP switch.
+ */
+class StreamSwitch {
+    public:
+    /**
+     * port 0 picks the next free port after the other streams.
+     */
+    StreamSwitch(const std::string& name, int port, const std::string& camera);
+    ~StreamSwitch();
+
+    StreamSwitch(const StreamSwitch&) = delete;
+    StreamSwitch& operator=(const StreamSwitch&) = delete;
+
+    /**
+     * The cameras that can be picked, by name, and their dashboard sources.
+     * Call again whenever a source changes.
+     */
+    void SetSources(const std::vector<std::pair<std::string, cs::VideoSource>>& sources);
+
+    /**
+     * Show camera from its next frame. Ignored until a camera of that name
+     * is among the sources.
+     */
+    void Select(const std::string& camera);
+
+    const std::string& GetName() const { return m_name; }
+
+    private:
+    // Called with m_mutex held
+    void Apply();
+
+    std::string m_name;
+    cs::MjpegServer m_server;
+    nt::NetworkTableEntry m_selectedEntry;
+    nt::NetworkTableEntry m_camerasEntry;
+    NT_EntryListener m_listener = 0;
+
+    // Shared with the NetworkTables listener, which may still be running on
+    // its own thread while the switch is destroyed
+    struct Owner {
+        std::mutex mutex;
+        StreamSwitch* stream;
+    };
+    std::shared_ptr<Owner> m_owner;
+
+    std::mutex m_mutex;
+    std::vector<std::pair<std::string, cs::VideoSource>> m_sources;
+    std::string m_selected;
+};
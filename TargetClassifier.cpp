@@ -0,0 +1,66 @@
+#include "TargetClassifier.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace {
+
+    // dst is 255 where bit is set in classes, 0 elsewhere
+    void classMask(const cv::Mat& classes, uint8_t bit, cv::Mat& dst) {
+        for (int y = 0; y < classes.rows; ++y) {
+            const uint8_t* c = classes.ptr<uint8_t>(y);
+            uint8_t* out = dst.ptr<uint8_t>(y);
+            for (int x = 0; x < classes.cols; ++x) out[x] = (c[x] & bit) != 0 ? 255 : 0;
+        }
+    }
+}  // namespace
+
+void TargetClassifier::SetTargets(const std::vector<TargetClass>& targets) {
+    CV_Assert(targets.size() <= ColorLut::kMaxClasses);
+    bool rebuild = targets.size() != m_targets.size();
+    for (size_t i = 0; !rebuild && i < targets.size(); ++i) rebuild = targets[i].ranges != m_targets[i].ranges;
+    m_targets = targets;
+    if (!rebuild) return;
+    std::vector<std::vector<ColorRange>> classes;
+    for (auto& target : m_targets) classes.push_back(target.ranges);
+    m_lut.SetClasses(classes);
+    for (auto& result : m_results) {
+        result.blobs.clear();
+        result.bounds = cv::Rect();
+        result.pixels = 0;
+    }
+}
+
+void TargetClassifier::Process(cv::Mat& mat) {
+    if (m_targets.empty()) return;
+    const cv::Mat* input = &mat;
+    if (m_blurRadius > 0) {
+        int size = 2 * m_blurRadius + 1;
+        cv::blur(mat, m_blurred, cv::Size(size, size));
+        input = &m_blurred;
+    }
+    m_lut.Classify(*input, m_classes);
+    m_mask.create(m_classes.size(), CV_8UC1);
+
+    cv::Rect bounds[ColorLut::kMaxClasses];
+    int counts[ColorLut::kMaxClasses];
+    classBounds(m_classes, bounds, counts);
+    for (size_t i = 0; i < m_targets.size(); ++i) {
+        TargetResult& result = m_results[i];
+        result.bounds = bounds[i];
+        result.pixels = counts[i];
+        if (counts[i] == 0) {
+            result.blobs.clear();
+            continue;
+        }
+        // Every pixel of the target is inside its bounds, so the blobs found
+        // there are the blobs of the whole mask
+        cv::Mat mask = m_mask(bounds[i]);
+        classMask(m_classes(bounds[i]), static_cast<uint8_t>(1 << i), mask);
+        m_finder.Find(mask, m_targets[i].filter, result.blobs, bounds[i].tl());
+    }
+}
+
+void TargetClassifier::GetMask(size_t target, cv::Mat& mask) const {
+    mask.create(m_classes.size(), CV_8UC1);
+    classMask(m_classes, static_cast<uint8_t>(1 << target), mask);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <vision/VisionPipeline.h>
+
+#include "BlobFilter.h"
+#include "ColorLut.h"
+
+/**
+ * One kind of target to look for, e.g. the cargo: the blobs of the pixels
+ * inside all of its colour ranges that pass its filter.
+ */
+struct TargetClass {
+    std::string name;
+    std::vector<ColorRange> ranges;
+    BlobFilter filter;
+
+    bool operator==(const TargetClass& other) const {
+        return name == other.name && ranges == other.ranges && filter == other.filter;
+    }
+    bool operator!=(const TargetClass& other) const { return !(*this == other); }
+};
+
+/**
+ * Where a target was found in the last frame: the blobs that passed its
+ * filter, largest first, and the box around every pixel that matched, empty
+ * if none did.
+ */
+struct TargetResult {
+    std::vector<cv::Rect> blobs;
+    cv::Rect bounds;
+    int pixels = 0;
+};
+
+/**
+ * Looks for several targets in one pass over a frame instead of running a
+ * pipeline per target that each blurs and converts the frame again.
+ *
+ * The frame is blurred once, then every pixel is classified against all the
+ * targets with a single ColorLut lookup into a CV_8UC1 image holding a bit
+ * per target. One more pass over that image finds the box around each
+ * target's pixels, and the blobs of a target are only looked for inside its
+ * box, in its bit of the class image, so a target that is not in view costs
+ * nothing more. Another target costs a bit in the table, not another
+ * threshold pass.
+ *
+ * Use with a PipelineConsumer; its input size takes the place of the resize
+ * the GRIP pipelines start with. Not thread safe, set the targets before the
+ * consumer is added or from its listener.
+ */
+class TargetClassifier : public frc::VisionPipeline {
+    public:
+    /**
+     * At most ColorLut::kMaxClasses targets. Rebuilds the lookup table only
+     * if the targets' ranges changed, new names and filters are free.
+     */
+    void SetTargets(const std::vector<TargetClass>& targets);
+
+    /**
+     * Box blur of radius pixels before classifying, 0 for none.
+     */
+    void SetBlur(int radius) { m_blurRadius = radius; }
+
+    void Process(cv::Mat& mat) override;
+
+    size_t GetTargetCount() const { return m_targets.size(); }
+    const std::string& GetName(size_t target) const { return m_targets[target].name; }
+    const TargetResult& GetResult(size_t target) const { return m_results[target]; }
+
+    /**
+     * The class image of the last frame, bit i set where target i matched.
+     */
+    const cv::Mat& GetClasses() const { return m_classes; }
+
+    /**
+     * 255 where target matched in the last frame, 0 elsewhere.
+     */
+    void GetMask(size_t target, cv::Mat& mask) const;
+
+    private:
+    std::vector<TargetClass> m_targets;
+    ColorLut m_lut;
+    int m_blurRadius = 0;
+
+    cv::Mat m_blurred;
+    cv::Mat m_classes;
+    // The mask of one target, only written inside its bounds
+    cv::Mat m_mask;
+    BlobFinder m_finder;
+    TargetResult m_results[ColorLut::kMaxClasses];
+};
@@ -0,0 +1,181 @@
+#include "YuyvCapture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+namespace {
+
+    // Buffers queued with the driver, enough to keep it busy while one is
+    // being copied
+    const unsigned kBuffers = 4;
+
+    int Ioctl(int fd, unsigned long request, void* arg) {
+        int result;
+        do {
+            result = ioctl(fd, request, arg);
+        } while (result == -1 && errno == EINTR);
+        return result;
+    }
+}  // namespace
+
+YuyvCapture::YuyvCapture(const std::string& path, const cs::VideoMode& mode, int divider)
+    : m_path(path), m_mode(mode) {
+    SetDivider(divider);
+    m_period = 1000000 / (mode.fps > 0 ? mode.fps : 30);
+}
+
+YuyvCapture::~YuyvCapture() {
+    Close();
+}
+
+void YuyvCapture::SetEnabled(bool enabled) {
+    m_enabled = enabled;
+    if (!enabled) Close();
+}
+
+bool YuyvCapture::Fail(const std::string& what) {
+    m_error = what + ": " + std::strerror(errno);
+    Close();
+    return false;
+}
+
+bool YuyvCapture::Open() {
+    m_fd = open(m_path.c_str(), O_RDWR | O_NONBLOCK);
+    if (m_fd < 0) return Fail("could not open " + m_path);
+
+    v4l2_format format;
+    std::memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = m_mode.width > 0 ? m_mode.width : 320;
+    format.fmt.pix.height = m_mode.height > 0 ? m_mode.height : 240;
+    format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    if (Ioctl(m_fd, VIDIOC_S_FMT, &format) < 0) return Fail("could not set format");
+    if (format.fmt.pix.pixelformat != V4L2_PIX_FMT_YUYV) {
+        errno = EINVAL;
+        return Fail("camera does not support YUYV");
+    }
+    m_width = format.fmt.pix.width;
+    m_height = format.fmt.pix.height;
+    m_stride = format.fmt.pix.bytesperline;
+    if (m_width != m_mode.width || m_height != m_mode.height) {
+        wpi::errs() << "camera '" << m_path << "': asked for " << m_mode.width << "x" << m_mode.height
+        << " YUYV, got " << m_width << "x" << m_height << '\n';
+    }
+
+    if (m_mode.fps > 0) {
+        // Not every camera can set its rate, keep going if it cannot
+        v4l2_streamparm parm;
+        std::memset(&parm, 0, sizeof(parm));
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator = 1;
+        parm.parm.capture.timeperframe.denominator = m_mode.fps;
+        Ioctl(m_fd, VIDIOC_S_PARM, &parm);
+    }
+
+    v4l2_requestbuffers request;
+    std::memset(&request, 0, sizeof(request));
+    request.count = kBuffers;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    if (Ioctl(m_fd, VIDIOC_REQBUFS, &request) < 0) return Fail("could not get buffers");
+
+    for (unsigned i = 0; i < request.count; ++i) {
+        v4l2_buffer buffer;
+        std::memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        if (Ioctl(m_fd, VIDIOC_QUERYBUF, &buffer) < 0) return Fail("could not query buffer");
+        void* start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, buffer.m.offset);
+        if (start == MAP_FAILED) return Fail("could not map buffer");
+        m_buffers.push_back(Buffer{start, buffer.length});
+        if (Ioctl(m_fd, VIDIOC_QBUF, &buffer) < 0) return Fail("could not queue buffer");
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (Ioctl(m_fd, VIDIOC_STREAMON, &type) < 0) return Fail("could not start streaming");
+    m_lastFrameTime = 0;
+    return true;
+}
+
+void YuyvCapture::Close() {
+    if (m_fd < 0) return;
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    Ioctl(m_fd, VIDIOC_STREAMOFF, &type);
+    for (auto& buffer : m_buffers) munmap(buffer.start, buffer.length);
+    m_buffers.clear();
+    close(m_fd);
+    m_fd = -1;
+}
+
+uint64_t YuyvCapture::GrabFrame(cv::Mat& image, double timeout) {
+    if (!m_enabled) {
+        m_error = "capture disabled";
+        return 0;
+    }
+    if (m_fd < 0 && !Open()) return 0;
+
+    while (true) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(m_fd, &fds);
+        struct timeval tv;
+        tv.tv_sec = static_cast<long>(timeout);
+        tv.tv_usec = static_cast<long>((timeout - tv.tv_sec) * 1.0e6);
+        int ready = select(m_fd + 1, &fds, nullptr, nullptr, &tv);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready < 0) {
+            Fail("select failed");
+            return 0;
+        }
+        if (ready == 0) {
+            m_error = "timed out getting frame";
+            return 0;
+        }
+
+        v4l2_buffer buffer;
+        std::memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        if (Ioctl(m_fd, VIDIOC_DQBUF, &buffer) < 0) {
+            if (errno == EAGAIN) continue;
+            // ENODEV when the camera is unplugged
+            Fail("could not get frame");
+            return 0;
+        }
+        uint64_t time = wpi::Now();
+        if (m_lastFrameTime != 0 && time > m_lastFrameTime) {
+            uint64_t period = time - m_lastFrameTime;
+            // Ignore gaps from camera stalls, they are not the frame rate
+            if (period < 8 * m_period) m_period = (7 * m_period + period) / 8;
+        }
+        m_lastFrameTime = time;
+
+        // Unwanted frames go straight back to the driver
+        bool wanted = m_count++ % m_divider == 0;
+        if (wanted && buffer.bytesused >= static_cast<uint32_t>(m_stride * m_height)) {
+            image.create(m_height, m_width, CV_8UC2);
+            const uint8_t* start = static_cast<const uint8_t*>(m_buffers[buffer.index].start);
+            for (int y = 0; y < m_height; ++y)
+                std::memcpy(image.ptr(y), start + y * m_stride, m_width * 2);
+        } else {
+            wanted = false;
+        }
+        if (Ioctl(m_fd, VIDIOC_QBUF, &buffer) < 0) {
+            Fail("could not queue buffer");
+            return 0;
+        }
+        if (wanted) return time;
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <cscore.h>
+#include <opencv2/core/core.hpp>
+
+/**
+ * Reads YUYV frames from a V4L2 camera directly, as a stand in for
+ * DecimatingSink when the vision pipelines can work on YUV.
+ *
+ * cscore always converts YUYV to BGR before handing frames out, which the
+ * pipelines then convert again to HSV or HLS. Frames from here are CV_8UC2
+ * images of Y,U / Y,V pairs, exactly as the camera sent them, and unwanted
+ * frames are dropped without even being copied.
+ *
+ * The device is opened on the first grab and closed while disabled or after
+ * an error, e.g. the camera being unplugged, and opened again on the next
+ * grab. cscore must not have the same device open.
+ */
+class YuyvCapture {
+    public:
+    YuyvCapture(const std::string& path, const cs::VideoMode& mode, int divider);
+    ~YuyvCapture();
+
+    YuyvCapture(const YuyvCapture&) = delete;
+    YuyvCapture& operator=(const YuyvCapture&) = delete;
+
+    /**
+     * Wait for the next wanted frame and copy it into image.
+     *
+     * @return Frame time in wpi::Now() microseconds, or 0 on error (call
+     *         GetError() for details)
+     */
+    uint64_t GrabFrame(cv::Mat& image, double timeout = 0.225);
+
+    std::string GetError() const { return m_error; }
+
+    /**
+     * Disabling closes the device so the camera stops streaming.
+     */
+    void SetEnabled(bool enabled);
+
+    void SetDivider(int divider) { m_divider = divider < 1 ? 1 : divider; }
+    int GetDivider() const { return m_divider; }
+
+    /**
+     * Estimated time between camera frames in microseconds.
+     */
+    uint64_t GetFramePeriod() const { return m_period; }
+
+    bool IsConnected() const { return m_fd >= 0; }
+
+    private:
+    struct Buffer {
+        void* start;
+        size_t length;
+    };
+
+    bool Open();
+    void Close();
+    bool Fail(const std::string& what);
+
+    std::string m_path;
+    cs::VideoMode m_mode;
+    int m_divider;
+    uint64_t m_period;
+    uint64_t m_lastFrameTime = 0;
+    uint64_t m_count = 0;
+    bool m_enabled = true;
+
+    int m_fd = -1;
+    std::vector<Buffer> m_buffers;
+    // Size the driver actually gave us
+    int m_width = 0;
+    int m_height = 0;
+    int m_stride = 0;
+    std::string m_error;
+};
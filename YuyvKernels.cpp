@@ -0,0 +1,89 @@
+#include "YuyvKernels.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace {
+
+    // BT.601 video range, fixed point with 20 bits, as in OpenCV's YUV422
+    // conversion
+    const int kShift = 20;
+    const int kCY = 1220542;
+    const int kCUB = 2116026;
+    const int kCUG = -409993;
+    const int kCVG = -852492;
+    const int kCVR = 1673527;
+
+    inline void ToBgr(int y, int u, int v, uint8_t* bgr) {
+        int yy = std::max(0, y - 16) * kCY;
+        u -= 128;
+        v -= 128;
+        const int round = 1 << (kShift - 1);
+        bgr[0] = cv::saturate_cast<uint8_t>((yy + round + kCUB * u) >> kShift);
+        bgr[1] = cv::saturate_cast<uint8_t>((yy + round + kCVG * v + kCUG * u) >> kShift);
+        bgr[2] = cv::saturate_cast<uint8_t>((yy + round + kCVR * v) >> kShift);
+    }
+
+    inline uint8_t InRange(int value, int lower, int upper) {
+        return static_cast<uint8_t>(-(value >= lower && value <= upper));
+    }
+}  // namespace
+
+void yuyvLuma(const cv::Mat& yuyv, cv::Mat& gray) {
+    CV_Assert(yuyv.type() == CV_8UC2);
+    cv::extractChannel(yuyv, gray, 0);
+}
+
+void yuyvInRange(const cv::Mat& yuyv, const cv::Scalar& lower, const cv::Scalar& upper, cv::Mat& mask) {
+    CV_Assert(yuyv.type() == CV_8UC2 && yuyv.cols % 2 == 0);
+    int yLower = cvCeil(lower[0]), yUpper = cvFloor(upper[0]);
+    int uLower = cvCeil(lower[1]), uUpper = cvFloor(upper[1]);
+    int vLower = cvCeil(lower[2]), vUpper = cvFloor(upper[2]);
+
+    mask.create(yuyv.rows, yuyv.cols, CV_8UC1);
+    for (int row = 0; row < yuyv.rows; ++row) {
+        const uint8_t* in = yuyv.ptr<uint8_t>(row);
+        uint8_t* out = mask.ptr<uint8_t>(row);
+        for (int x = 0; x < yuyv.cols; x += 2, in += 4) {
+            uint8_t uv = InRange(in[1], uLower, uUpper) & InRange(in[3], vLower, vUpper);
+            out[x] = uv & InRange(in[0], yLower, yUpper);
+            out[x + 1] = uv & InRange(in[2], yLower, yUpper);
+        }
+    }
+}
+
+void yuyvToBgr(const cv::Mat& yuyv, cv::Mat& bgr, int factor) {
+    CV_Assert(yuyv.type() == CV_8UC2 && (factor == 1 || factor == 2 || factor == 4));
+    if (factor == 1) {
+        cv::cvtColor(yuyv, bgr, cv::COLOR_YUV2BGR_YUYV);
+        return;
+    }
+
+    int width = yuyv.cols / factor;
+    int height = yuyv.rows / factor;
+    // Every block has factor * factor lumas and half as many U,V pairs
+    const int area = factor * factor;
+    const int pairs = area / 2;
+    bgr.create(height, width, CV_8UC3);
+
+    const uint8_t* rows[4];
+    for (int y = 0; y < height; ++y) {
+        for (int k = 0; k < factor; ++k) rows[k] = yuyv.ptr<uint8_t>(y * factor + k);
+        uint8_t* out = bgr.ptr<uint8_t>(y);
+        for (int x = 0; x < width; ++x, out += 3) {
+            int ySum = 0, uSum = 0, vSum = 0;
+            int start = x * factor * 2;
+            for (int k = 0; k < factor; ++k) {
+                const uint8_t* in = rows[k] + start;
+                for (int i = 0; i < factor * 2; i += 4) {
+                    ySum += in[i] + in[i + 2];
+                    uSum += in[i + 1];
+                    vSum += in[i + 3];
+                }
+            }
+            ToBgr((ySum + area / 2) / area, (uSum + pairs / 2) / pairs, (vSum + pairs / 2) / pairs, out);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+
+/*
+   Kernels that work on YUYV frames (CV_8UC2, Y,U / Y,V pairs) as they come
+   from YuyvCapture, so vision code can threshold and stream them without
+   first converting the whole frame to BGR and then again to HSV.
+ */
+
+/**
+ * The luma of every pixel as a gray image, for pipelines that only need
+ * brightness, e.g. finding retroreflective tape lit by a ring light.
+ */
+void yuyvLuma(const cv::Mat& yuyv, cv::Mat& gray);
+
+/**
+ * Like cv::inRange with lower and upper as (Y, U, V): mask is 255 where the
+ * pixel falls in the box and 0 elsewhere. U and V are shared by each pair of
+ * pixels so they are only tested once per pair.
+ */
+void yuyvInRange(const cv::Mat& yuyv, const cv::Scalar& lower, const cv::Scalar& upper, cv::Mat& mask);
+
+/**
+ * Convert to BGR while shrinking by factor (1, 2 or 4) in both directions.
+ * Each n x n block is averaged in YUV and only the result is converted, so a
+ * 4:1 stream converts one pixel in sixteen. Uses the same BT.601 coefficients
+ * as cv::cvtColor.
+ */
+void yuyvToBgr(const cv::Mat& yuyv, cv::Mat& bgr, int factor = 1);
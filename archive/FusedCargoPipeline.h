@@ -0,0 +1,27 @@
+#pragma once
+#include "PixelStages.h"
+
+namespace cargoGrip {
+
+/**
+* GripCargoPipeline's HSL threshold, mask and RGB threshold as one fused
+* per-pixel test, see PixelStages.h.
+*/
+typedef stages::Masked<stages::InRange<stages::Hls>, stages::InRange<stages::Rgb>> FusedCargoTest;
+typedef stages::FusedPipeline<FusedCargoTest> FusedCargoPipeline;
+
+/**
+* A pipeline with the same steps and values as GripCargoPipeline, GetOutput()
+* giving its RGB threshold output. For frc::VisionRunner<FusedCargoPipeline>.
+* @return a new pipeline, owned by the caller.
+*/
+inline FusedCargoPipeline* NewFusedCargoPipeline() {
+	FusedCargoTest test(
+		stages::InRange<stages::Hls>(cv::Scalar(0.0, 98.60611510791367, 188.03956834532374),
+			cv::Scalar(50.98976109215017, 204.95733788395904, 255.0)),
+		stages::InRange<stages::Rgb>(cv::Scalar(206.38489208633092, 64.20863309352518, 11.465827338129495),
+			cv::Scalar(255.0, 215.83617747440275, 141.86006825938566)));
+	return new FusedCargoPipeline(cv::Size(240, 180), 12.612612612612613, test, cv::INTER_CUBIC);
+}
+
+} // end namespace cargoGrip
@@ -27,19 +27,33 @@ void GripCargoPipeline::Process(cv::Mat& source0){
 	double hslThresholdHue[] = {0.0, 50.98976109215017};
 	double hslThresholdSaturation[] = {188.03956834532374, 255.0};
 	double hslThresholdLuminance[] = {98.60611510791367, 204.95733788395904};
-	hslThreshold(hslThresholdInput, hslThresholdHue, hslThresholdSaturation, hslThresholdLuminance, this->hslThresholdOutput);
+	if (!useColorLut) {
+		hslThreshold(hslThresholdInput, hslThresholdHue, hslThresholdSaturation, hslThresholdLuminance, this->hslThresholdOutput);
+	} else {
+		// Not produced, empty rather than left over from an earlier frame
+		this->hslThresholdOutput.release();
+	}
 	//Step Mask0:
 	//input
 	cv::Mat maskInput = blurOutput;
 	cv::Mat maskMask = hslThresholdOutput;
-	mask(maskInput, maskMask, this->maskOutput);
+	if (!useColorLut) {
+		mask(maskInput, maskMask, this->maskOutput);
+	} else {
+		this->maskOutput.release();
+	}
 	//Step RGB_Threshold0:
 	//input
 	cv::Mat rgbThresholdInput = maskOutput;
 	double rgbThresholdRed[] = {206.38489208633092, 255.0};
 	double rgbThresholdGreen[] = {64.20863309352518, 215.83617747440275};
 	double rgbThresholdBlue[] = {11.465827338129495, 141.86006825938566};
-	rgbThreshold(rgbThresholdInput, rgbThresholdRed, rgbThresholdGreen, rgbThresholdBlue, this->rgbThresholdOutput);
+	if (useColorLut) {
+		// All three steps in one lookup per pixel
+		hslRgbThreshold(blurOutput, hslThresholdHue, hslThresholdSaturation, hslThresholdLuminance, rgbThresholdRed, rgbThresholdGreen, rgbThresholdBlue, this->rgbThresholdOutput);
+	} else {
+		rgbThreshold(rgbThresholdInput, rgbThresholdRed, rgbThresholdGreen, rgbThresholdBlue, this->rgbThresholdOutput);
+	}
 }
 
 /**
@@ -58,6 +72,7 @@ cv::Mat* GripCargoPipeline::GetBlurOutput(){
 }
 /**
  * This method is a generated getter for the output of a HSL_Threshold.
+ * Empty while the ColorLut is used, see SetColorLut().
  * @return Mat output from HSL_Threshold.
  */
 cv::Mat* GripCargoPipeline::GetHslThresholdOutput(){
@@ -65,6 +80,7 @@ cv::Mat* GripCargoPipeline::GetHslThresholdOutput(){
 }
 /**
  * This method is a generated getter for the output of a Mask.
+ * Empty while the ColorLut is used, see SetColorLut().
  * @return Mat output from Mask.
  */
 cv::Mat* GripCargoPipeline::GetMaskOutput(){
@@ -76,6 +92,16 @@ cv::Mat* GripCargoPipeline::GetMaskOutput(){
  */
 cv::Mat* GripCargoPipeline::GetRgbThresholdOutput(){
 	return &(this->rgbThresholdOutput);
+}
+/**
+ * Do the HSL threshold, mask and RGB threshold steps as one lookup per pixel
+ * in a ColorLut. Off by default: the table is quantised, so colours within 4
+ * levels of a range edge can come out on the wrong side. The HSL threshold
+ * and mask outputs are empty while it is used.
+ * @param use false to go back to the separate steps.
+ */
+void GripCargoPipeline::SetColorLut(bool use){
+	this->useColorLut = use;
 }
 	/**
 	 * Scales and image to an exact size.
@@ -161,6 +187,33 @@ cv::Mat* GripCargoPipeline::GetRgbThresholdOutput(){
 		cv::inRange(output, cv::Scalar(red[0], green[0], blue[0]), cv::Scalar(red[1], green[1], blue[1]), output);
 	}
 
+	/**
+	 * Segment an image to the pixels inside both an HSL and an RGB range,
+	 * which is what masking with the HSL threshold and then RGB thresholding
+	 * gives when black is outside the RGB range.
+	 *
+	 * @param input The image on which to perform the threshold.
+	 * @param hue The min and max hue.
+	 * @param sat The min and max saturation.
+	 * @param lum The min and max luminance.
+	 * @param red The min and max red.
+	 * @param green The min and max green.
+	 * @param blue The min and max blue.
+	 * @param output The image in which to store the output.
+	 */
+	void GripCargoPipeline::hslRgbThreshold(cv::Mat &input, double hue[], double sat[], double lum[], double red[], double green[], double blue[], cv::Mat &output) {
+		ColorRange hsl, rgb;
+		hsl.space = ColorRange::kHls;
+		hsl.lower = cv::Scalar(hue[0], lum[0], sat[0]);
+		hsl.upper = cv::Scalar(hue[1], lum[1], sat[1]);
+		rgb.space = ColorRange::kRgb;
+		rgb.lower = cv::Scalar(red[0], green[0], blue[0]);
+		rgb.upper = cv::Scalar(red[1], green[1], blue[1]);
+		// Only rebuilt if the ranges changed
+		colorLut.SetRanges({hsl, rgb});
+		colorLut.Threshold(input, output);
+	}
+
 
 
 } // end grip namespace
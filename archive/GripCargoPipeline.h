@@ -12,6 +12,7 @@
 #include <vector>
 #include <string>
 #include <math.h>
+#include "ColorLut.h"
 
 namespace cargoGrip {
 
@@ -34,11 +35,14 @@ class GripCargoPipeline : public frc::VisionPipeline {
 		cv::Mat hslThresholdOutput;
 		cv::Mat maskOutput;
 		cv::Mat rgbThresholdOutput;
+		ColorLut colorLut;
+		bool useColorLut = false;
 		void resizeImage(cv::Mat &, double , double , int , cv::Mat &);
 		void blur(cv::Mat &, BlurType &, double , cv::Mat &);
 		void hslThreshold(cv::Mat &, double [], double [], double [], cv::Mat &);
 		void mask(cv::Mat &, cv::Mat &, cv::Mat &);
 		void rgbThreshold(cv::Mat &, double [], double [], double [], cv::Mat &);
+		void hslRgbThreshold(cv::Mat &, double [], double [], double [], double [], double [], double [], cv::Mat &);
 
 	public:
 		GripCargoPipeline();
@@ -48,6 +52,7 @@ class GripCargoPipeline : public frc::VisionPipeline {
 		cv::Mat* GetHslThresholdOutput();
 		cv::Mat* GetMaskOutput();
 		cv::Mat* GetRgbThresholdOutput();
+		void SetColorLut(bool use);
 };
 
 
@@ -12,6 +12,7 @@
 #include <vector>
 #include <string>
 #include <math.h>
+#include "HsvThreshold.h"
 
 namespace hatchGrip {
 
@@ -32,6 +33,7 @@ class GripHatchPipeline : public frc::VisionPipeline {
 		cv::Mat resizeImageOutput;
 		cv::Mat blurOutput;
 		cv::Mat hsvThresholdOutput;
+		bool fusedThreshold = true;
 		void resizeImage(cv::Mat &, double , double , int , cv::Mat &);
 		void blur(cv::Mat &, BlurType &, double , cv::Mat &);
 		void hsvThreshold(cv::Mat &, double [], double [], double [], cv::Mat &);
@@ -42,6 +44,7 @@ class GripHatchPipeline : public frc::VisionPipeline {
 		cv::Mat* GetResizeImageOutput();
 		cv::Mat* GetBlurOutput();
 		cv::Mat* GetHsvThresholdOutput();
+		void SetFusedThreshold(bool fused);
 };
 
 
@@ -50,6 +50,15 @@ cv::Mat* GripStripPipeline::GetBlurOutput(){
  */
 cv::Mat* GripStripPipeline::GetHsvThresholdOutput(){
 	return &(this->hsvThresholdOutput);
+}
+/**
+ * Threshold with fusedHsvThreshold(), which gives the same mask as
+ * cvtColor and inRange without the HSV image in between. On by default, the
+ * HSV image was never an output.
+ * @param fused false to go back to cvtColor and inRange.
+ */
+void GripStripPipeline::SetFusedThreshold(bool fused){
+	this->fusedThreshold = fused;
 }
 	/**
 	 * Scales and image to an exact size.
@@ -103,6 +112,10 @@ cv::Mat* GripStripPipeline::GetHsvThresholdOutput(){
 	 * @param output The image in which to store the output.
 	 */
 	void GripStripPipeline::hsvThreshold(cv::Mat &input, double hue[], double sat[], double val[], cv::Mat &out) {
+		if (fusedThreshold) {
+			fusedHsvThreshold(input, hue, sat, val, out);
+			return;
+		}
 		cv::cvtColor(input, out, cv::COLOR_BGR2HSV);
 		cv::inRange(out,cv::Scalar(hue[0], sat[0], val[0]), cv::Scalar(hue[1], sat[1], val[1]), out);
 	}
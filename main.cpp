@@ -5,7 +5,12 @@
 /* the project.                                                               */
 /*----------------------------------------------------------------------------*/
 
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <csignal>
 #include <cstdio>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
@@ -18,6 +23,14 @@
 #include <wpi/raw_ostream.h>
 
 #include "cameraserver/CameraServer.h"
+#include "BandwidthGovernor.h"
+#include "CameraWorker.h"
+#include "ConfiguredPipeline.h"
+#include "MatPool.h"
+#include "MosaicOutput.h"
+#include "PipelineConsumer.h"
+#include "Scheduler.h"
+#include "StreamSwitch.h"
 #include <opencv2/core/core.hpp>
 #include <opencv2/core/types.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -30,6 +43,7 @@
 #include <frc/smartdashboard/SmartDashboard.h>
 #include <networktables/NetworkTable.h>
 #include <networktables/NetworkTableEntry.h>
+#include <networktables/NetworkTableInstance.h>
 
 #include <iostream>
 
@@ -468,10 +482,13 @@ void LIDARLite_v3::correlationRecordRead(__s16 * correlationArray,
    {
        "team": <team number>,
        "ntmode": <"client" or "server", "client" if unspecified>
+       "bandwidth": <Mbit/s for all dashboard streams> // optional, no limit
+       "mat pool": <MB of freed image buffers to keep> // optional, 32
        "cameras": [
            {
                "name": <camera name>
                "path": <path, e.g. "/dev/video0">
+               "raw": <capture YUYV without cscore> // optional, false
                "pixel format": <"MJPEG", "YUYV", etc>   // optional
                "width": <video mode width>              // optional
                "height": <video mode height>            // optional
@@ -492,33 +509,465 @@ void LIDARLite_v3::correlationRecordRead(__s16 * correlationArray,
                            "value": <stream property value>
                        }
                    ]
+               },
+               "output": {                              // optional
+                   "name": <dashboard stream name>      // optional, "<camera name>Cam"
+                   "width": <output width>              // optional, 320
+                   "height": <output height>            // optional, 240
+                   "crop": [<x>, <y>, <width>, <height>] // optional, camera pixels
+                   "gray": <send luma only>             // optional, false
+                   "overlay": [                         // optional
+                       {
+                           "type": <"crosshair", "box", "text" or "targets">
+                           "x": <output x>, "y": <output y> // centre, top left or text start
+                           "width": <box width>, "height": <box height>
+                           "length": <crosshair arm length> // optional, 25
+                           "gap": <crosshair gap at centre> // optional, 15
+                           "text": <text>, "scale": <font scale> // optional, 0.5
+                           "color": [<red>, <green>, <blue>] // optional, red
+                           "thickness": <line thickness> // optional, 1
+                       }
+                   ],
+                   "divider": <send every nth frame>    // optional, 2
+                   "priority": <bandwidth priority>     // optional, 0
+                   "skip static": <only send changed frames> // optional, false
+                   "keepalive": <max ms between frames> // optional, 1000
+                   "decimate": <skip frames before decode> // optional, true
+                   "passthrough": <send camera MJPEG as is> // optional, false
+                   "core": <CPU core to pin worker to>  // optional, not pinned
+               },
+               "schedule": {                            // optional
+                   "vision priority": <SCHED_FIFO 1-99> // optional, not real time
+                   "vision nice": <nice value>          // optional, 0
+                   "deadline": <vision latency in ms>   // optional, none
+                   "stream nice": <nice value>          // optional, 0
                }
            }
        ]
+       "switch": {                                  // optional
+           "name": <dashboard stream name>
+           "port": <HTTP port>                  // optional, next free
+           "camera": <camera shown at first>    // optional, first camera
+       }
+       "mosaics": [                                 // optional
+           {
+               "name": <dashboard stream name>
+               "width": <mosaic width>              // optional, 640
+               "height": <mosaic height>            // optional, 240
+               "fps": <most frames per second sent> // optional, 15
+               "tiles": [
+                   {
+                       "camera": <camera name>
+                       "x": <x>, "y": <y>, "width": <width>, "height": <height>
+                       "divider": <draw every nth frame> // optional, 2
+                   }
+               ]
+           }
+       ]
+       "pipelines": [                               // optional
+           {
+               "name": <pipeline name>
+               "camera": <camera name>
+               "divider": <run on every nth frame>  // optional, 1
+               "steps": [
+                   {
+                       "type": <"resize", "blur", "threshold", "mask", "blobs" or "targets">
+                       "width": <width>, "height": <height> // resize
+                       "blur": <"box", "gaussian" or "median"> // blur, optional, "box"
+                       "radius": <blur radius in pixels> // blur
+                       "space": <"hsv", "hsl", "rgb" or "yuv"> // threshold
+                       "hue": [<min>, <max>]            // threshold, optional, all
+                       "saturation", "value", "luminance", "red", "green", "blue", "y", "u", "v" // the same
+                       "lut": <true to look the colours up in a table> // threshold, optional, false
+                       "min area": <pixels>, "max area": <pixels> // blobs, optional
+                       "min width", "max width", "min height", "max height" // blobs, optional
+                       "min ratio", "max ratio": <width / height> // blobs, optional
+                       "max blobs": <largest blobs kept> // blobs, optional, 10
+                       "targets": [                      // targets, 1 to 8
+                           {
+                               "name": <target name>
+                               "thresholds": [ <"space" and channels as for threshold> ]
+                               "min area" ... "max blobs" // optional, as for blobs
+                           }
+                       ]
+                   }
+               ]
+           }
+       ]
    }
  */
 
+/*
+   A "raw" camera is read with V4L2 directly and its frames reach the pipelines
+   as YUYV, so they are never converted to BGR unless a pipeline needs it.
+   Only its width, height and fps are used, cscore properties do not apply.
+   A pipeline on a raw camera that starts with a "yuv" threshold, followed
+   only by blobs, tests the YUYV frame as it is, Y, U and V 0-255, with no
+   conversion to BGR or HSV at all.
+ */
+
+/*
+   A mosaic tiles several cameras into one dashboard stream, which is encoded
+   once and needs only one connection. The cameras keep their own streams, so
+   give them an "output" "divider" high enough to be cheap or leave them
+   unwatched.
+ */
+
+/*
+   The "switch" stream shows one camera at a time, picked with the
+   CameraSwitch/<name>/selected string in NetworkTables. Cameras are kept open
+   while it exists, so switching does not wait for a camera to start, but
+   only the camera shown is decoded.
+ */
+
+/*
+   A pipeline runs its steps in order on the camera's BGR frames, like the
+   GRIP pipelines did: resize and blur change the image, a threshold makes the
+   mask of the pixels inside its ranges (hue 0-180, the rest 0-255), mask
+   blacks out the image outside the mask and blobs finds the targets in the
+   mask. The blobs, largest first and in camera pixels, are published as the
+   centerX, centerY, width, height and area arrays of CameraPipelines/<name>
+   and drawn on the camera's stream if its overlay has "targets". Changing
+   thresholds or filters takes effect on the next frame without stopping the
+   pipeline, only different steps or sizes build it again.
+
+   HSV and RGB thresholds already take one pass over the image. An HSL
+   threshold converts the whole image first, which "lut": true avoids by
+   looking every colour up in a table built from the threshold, at the cost
+   of colours within 4 levels of a bound landing on either side. It is off by
+   default so a threshold tuned in GRIP gives the same mask here.
+
+   A targets step looks for several targets in one pass: a pixel belongs to a
+   target if it is inside all of the target's thresholds, and each target
+   gets its own blobs with its own filter, published under
+   CameraPipelines/<name>/<target name>. Its mask, for later mask and blobs
+   steps, is the pixels of any target. One targets step is cheaper than a
+   threshold and blobs pipeline per target, as the image is only converted
+   once, but its thresholds are looked up in a table of 64 levels per
+   channel, so colours within 4 levels of a bound may land on either side.
+ */
+
+/*
+   The file is read again on SIGHUP ("sudo svc -h /service/camera") or when it
+   changes. Only what changed is applied, cameras whose config did not change
+   keep streaming. Changes to "team" and "ntmode" still need a restart.
+ */
+
 static const char* configFile = "/boot/frc.json";
 
 namespace {
 
     unsigned int team;
     bool server = false;
+    // Dashboard stream budget in Mbit/s, 0 for none
+    double bandwidth = 0;
+    // Freed image buffers kept for reuse, in MB
+    double matPool = 32;
 
     struct CameraConfig {
         std::string name;
         std::string path;
+        // Camera settings for cscore, without the keys read into the rest
         wpi::json config;
         wpi::json streamConfig;
+        WorkerConfig output;
+        bool raw = false;
+        cs::VideoMode rawMode;
     };
 
     std::vector<CameraConfig> cameraConfigs;
+    std::vector<MosaicConfig> mosaicConfigs;
+    std::vector<PipelineConfig> pipelineConfigs;
+
+    struct SwitchConfig {
+        // Empty for no switch
+        std::string name;
+        int port = 0;
+        std::string camera;
+
+        bool operator==(const SwitchConfig& other) const {
+            return name == other.name && port == other.port && camera == other.camera;
+        }
+        bool operator!=(const SwitchConfig& other) const { return !(*this == other); }
+    };
+
+    SwitchConfig switchConfig;
 
     wpi::raw_ostream& ParseError() {
         return wpi::errs() << "config error in '" << configFile << "': ";
     }
 
-    bool ReadCameraConfig(const wpi::json& config) {
+    // Throws wpi::json::exception for values of the wrong type
+    bool ReadOverlay(const std::string& camera, const wpi::json& item, Overlay& overlay) {
+        auto str = item.at("type").get<std::string>();
+        wpi::StringRef type(str);
+        if (type.equals_lower("crosshair")) {
+            overlay.kind = Overlay::kCrosshair;
+        } else if (type.equals_lower("box")) {
+            overlay.kind = Overlay::kBox;
+        } else if (type.equals_lower("text")) {
+            overlay.kind = Overlay::kText;
+        } else if (type.equals_lower("targets")) {
+            overlay.kind = Overlay::kTargets;
+        } else {
+            ParseError() << "camera '" << camera << "': unknown overlay type '" << str << "'\n";
+            return false;
+        }
+        if (item.count("x") != 0) overlay.position.x = item.at("x").get<int>();
+        if (item.count("y") != 0) overlay.position.y = item.at("y").get<int>();
+        if (item.count("width") != 0) overlay.size.width = item.at("width").get<int>();
+        if (item.count("height") != 0) overlay.size.height = item.at("height").get<int>();
+        if (item.count("length") != 0) overlay.length = item.at("length").get<int>();
+        if (item.count("gap") != 0) overlay.gap = item.at("gap").get<int>();
+        if (item.count("text") != 0) overlay.text = item.at("text").get<std::string>();
+        if (item.count("scale") != 0) overlay.scale = item.at("scale").get<double>();
+        if (item.count("thickness") != 0) overlay.thickness = item.at("thickness").get<int>();
+        if (item.count("color") != 0) {
+            auto rgb = item.at("color").get<std::vector<int>>();
+            if (rgb.size() != 3) {
+                ParseError() << "camera '" << camera << "': overlay color must be [red, green, blue]\n";
+                return false;
+            }
+            overlay.color = cv::Scalar(rgb[2], rgb[1], rgb[0]);
+        }
+        return true;
+    }
+
+    bool ReadMosaicConfig(const wpi::json& config, std::vector<MosaicConfig>& configs) {
+        MosaicConfig c;
+
+        // name
+        try {
+            c.name = config.at("name").get<std::string>();
+        } catch (const wpi::json::exception& e) {
+            ParseError() << "could not read mosaic name: " << e.what() << '\n';
+            return false;
+        }
+
+        try {
+            if (config.count("width") != 0) c.width = config.at("width").get<int>();
+            if (config.count("height") != 0) c.height = config.at("height").get<int>();
+            if (config.count("fps") != 0) c.fps = config.at("fps").get<int>();
+            for (auto&& item : config.at("tiles")) {
+                MosaicTile tile;
+                tile.camera = item.at("camera").get<std::string>();
+                tile.rect = cv::Rect(item.at("x").get<int>(), item.at("y").get<int>(),
+                                     item.at("width").get<int>(), item.at("height").get<int>());
+                if (item.count("divider") != 0) tile.divider = item.at("divider").get<int>();
+                c.tiles.push_back(tile);
+            }
+        } catch (const wpi::json::exception& e) {
+            ParseError() << "mosaic '" << c.name << "': could not read tiles: " << e.what() << '\n';
+            return false;
+        }
+        if (c.width <= 0 || c.height <= 0) {
+            ParseError() << "mosaic '" << c.name << "': width and height must be positive\n";
+            return false;
+        }
+
+        configs.emplace_back(std::move(c));
+        return true;
+    }
+
+    // [min, max] of a threshold channel, all of it if not given. Throws
+    // wpi::json::exception for values of the wrong type
+    bool ReadBounds(const std::string& pipeline, const wpi::json& item, const char* key, double max,
+                    cv::Vec2d& bounds) {
+        bounds = cv::Vec2d(0, max);
+        if (item.count(key) == 0) return true;
+        auto minMax = item.at(key).get<std::vector<double>>();
+        if (minMax.size() != 2) {
+            ParseError() << "pipeline '" << pipeline << "': " << key << " must be [min, max]\n";
+            return false;
+        }
+        bounds = cv::Vec2d(minMax[0], minMax[1]);
+        return true;
+    }
+
+    // The space and channel bounds of a threshold. Throws
+    // wpi::json::exception for values of the wrong type
+    bool ReadColorRange(const std::string& pipeline, const wpi::json& item, ColorRange& range) {
+        auto space = item.at("space").get<std::string>();
+        wpi::StringRef sp(space);
+        // Channels in the order cv::cvtColor puts them
+        std::vector<const char*> keys;
+        double max[3] = {255, 255, 255};
+        if (sp.equals_lower("hsv")) {
+            range.space = ColorRange::kHsv;
+            keys = {"hue", "saturation", "value"};
+            max[0] = 180;
+        } else if (sp.equals_lower("hsl")) {
+            range.space = ColorRange::kHls;
+            keys = {"hue", "luminance", "saturation"};
+            max[0] = 180;
+        } else if (sp.equals_lower("rgb")) {
+            range.space = ColorRange::kRgb;
+            keys = {"red", "green", "blue"};
+        } else if (sp.equals_lower("yuv")) {
+            range.space = ColorRange::kYuv;
+            keys = {"y", "u", "v"};
+        } else {
+            ParseError() << "pipeline '" << pipeline << "': unknown threshold space '" << space << "'\n";
+            return false;
+        }
+        cv::Vec2d channels[3];
+        for (int i = 0; i < 3; ++i) {
+            if (!ReadBounds(pipeline, item, keys[i], max[i], channels[i])) return false;
+        }
+        range.lower = cv::Scalar(channels[0][0], channels[1][0], channels[2][0]);
+        range.upper = cv::Scalar(channels[0][1], channels[1][1], channels[2][1]);
+        return true;
+    }
+
+    // The optional blob filter keys of item. Throws wpi::json::exception for
+    // values of the wrong type
+    void ReadBlobFilter(const wpi::json& item, BlobFilter& filter) {
+        if (item.count("min area") != 0) filter.minArea = item.at("min area").get<double>();
+        if (item.count("max area") != 0) filter.maxArea = item.at("max area").get<double>();
+        if (item.count("min width") != 0) filter.minWidth = item.at("min width").get<int>();
+        if (item.count("max width") != 0) filter.maxWidth = item.at("max width").get<int>();
+        if (item.count("min height") != 0) filter.minHeight = item.at("min height").get<int>();
+        if (item.count("max height") != 0) filter.maxHeight = item.at("max height").get<int>();
+        if (item.count("min ratio") != 0) filter.minRatio = item.at("min ratio").get<double>();
+        if (item.count("max ratio") != 0) filter.maxRatio = item.at("max ratio").get<double>();
+        if (item.count("max blobs") != 0) filter.maxBlobs = item.at("max blobs").get<int>();
+    }
+
+    // Throws wpi::json::exception for values of the wrong type
+    bool ReadPipelineStep(const std::string& pipeline, const wpi::json& item, PipelineStep& step) {
+        auto str = item.at("type").get<std::string>();
+        wpi::StringRef type(str);
+        if (type.equals_lower("resize")) {
+            step.kind = PipelineStep::kResize;
+            step.size = cv::Size(item.at("width").get<int>(), item.at("height").get<int>());
+            if (step.size.width <= 0 || step.size.height <= 0) {
+                ParseError() << "pipeline '" << pipeline << "': resize width and height must be positive\n";
+                return false;
+            }
+        } else if (type.equals_lower("blur")) {
+            step.kind = PipelineStep::kBlur;
+            step.radius = item.at("radius").get<double>();
+            if (item.count("blur") != 0) {
+                auto blur = item.at("blur").get<std::string>();
+                wpi::StringRef b(blur);
+                if (b.equals_lower("box")) {
+                    step.blurType = PipelineStep::kBox;
+                } else if (b.equals_lower("gaussian")) {
+                    step.blurType = PipelineStep::kGaussian;
+                } else if (b.equals_lower("median")) {
+                    step.blurType = PipelineStep::kMedian;
+                } else {
+                    ParseError() << "pipeline '" << pipeline << "': unknown blur '" << blur << "'\n";
+                    return false;
+                }
+            }
+        } else if (type.equals_lower("threshold")) {
+            step.kind = PipelineStep::kThreshold;
+            if (!ReadColorRange(pipeline, item, step.range)) return false;
+            if (item.count("lut") != 0) step.lut = item.at("lut").get<bool>();
+            if (step.lut && step.range.space == ColorRange::kYuv) {
+                ParseError() << "pipeline '" << pipeline << "': a yuv threshold cannot use a lut\n";
+                return false;
+            }
+        } else if (type.equals_lower("mask")) {
+            step.kind = PipelineStep::kMask;
+        } else if (type.equals_lower("blobs")) {
+            step.kind = PipelineStep::kBlobs;
+            ReadBlobFilter(item, step.filter);
+        } else if (type.equals_lower("targets")) {
+            step.kind = PipelineStep::kTargets;
+            for (auto&& t : item.at("targets")) {
+                TargetClass target;
+                target.name = t.at("name").get<std::string>();
+                for (auto&& range : t.at("thresholds")) {
+                    target.ranges.emplace_back();
+                    if (!ReadColorRange(pipeline, range, target.ranges.back())) return false;
+                    if (target.ranges.back().space == ColorRange::kYuv) {
+                        ParseError() << "pipeline '" << pipeline << "': targets cannot use yuv thresholds\n";
+                        return false;
+                    }
+                }
+                ReadBlobFilter(t, target.filter);
+                for (auto& other : step.targets) {
+                    if (other.name == target.name) {
+                        ParseError() << "pipeline '" << pipeline << "': duplicate target '" << target.name << "'\n";
+                        return false;
+                    }
+                }
+                step.targets.push_back(target);
+            }
+            if (step.targets.empty() || step.targets.size() > ColorLut::kMaxClasses) {
+                ParseError() << "pipeline '" << pipeline << "': targets must have 1 to " << ColorLut::kMaxClasses
+                             << " targets\n";
+                return false;
+            }
+        } else {
+            ParseError() << "pipeline '" << pipeline << "': unknown step type '" << str << "'\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool ReadPipelineConfig(const wpi::json& config, std::vector<PipelineConfig>& configs) {
+        PipelineConfig c;
+
+        // name
+        try {
+            c.name = config.at("name").get<std::string>();
+        } catch (const wpi::json::exception& e) {
+            ParseError() << "could not read pipeline name: " << e.what() << '\n';
+            return false;
+        }
+
+        try {
+            c.camera = config.at("camera").get<std::string>();
+            if (config.count("divider") != 0) c.divider = config.at("divider").get<int>();
+            for (auto&& item : config.at("steps")) {
+                PipelineStep step;
+                if (!ReadPipelineStep(c.name, item, step)) return false;
+                c.steps.push_back(step);
+            }
+        } catch (const wpi::json::exception& e) {
+            ParseError() << "pipeline '" << c.name << "': could not read steps: " << e.what() << '\n';
+            return false;
+        }
+
+        // mask and blobs work on the mask of an earlier threshold or targets
+        // step, and the targets' results are published by target name
+        bool threshold = false;
+        int targets = 0;
+        for (auto& step : c.steps) {
+            if (step.kind == PipelineStep::kThreshold || step.kind == PipelineStep::kTargets) threshold = true;
+            if (step.kind == PipelineStep::kTargets) ++targets;
+            if ((step.kind == PipelineStep::kMask || step.kind == PipelineStep::kBlobs) && !threshold) {
+                ParseError() << "pipeline '" << c.name << "': mask and blobs need a threshold before them\n";
+                return false;
+            }
+        }
+        if (targets > 1) {
+            ParseError() << "pipeline '" << c.name << "': only one targets step allowed\n";
+            return false;
+        }
+        // a yuv threshold works on the YUYV frame itself, which only blobs
+        // can follow
+        for (size_t i = 0; i < c.steps.size(); ++i) {
+            if (c.steps[i].kind != PipelineStep::kThreshold || c.steps[i].range.space != ColorRange::kYuv) continue;
+            bool blobsAfter = true;
+            for (size_t k = i + 1; k < c.steps.size(); ++k) {
+                if (c.steps[k].kind != PipelineStep::kBlobs) blobsAfter = false;
+            }
+            if (i != 0 || !blobsAfter) {
+                ParseError() << "pipeline '" << c.name << "': a yuv threshold must be the first step, "
+                             << "followed only by blobs\n";
+                return false;
+            }
+        }
+
+        configs.emplace_back(std::move(c));
+        return true;
+    }
+
+    bool ReadCameraConfig(const wpi::json& config, std::vector<CameraConfig>& configs) {
         CameraConfig c;
 
         // name
@@ -538,15 +987,89 @@ namespace {
             return false;
         }
 
+        // raw YUYV capture (optional)
+        if (config.count("raw") != 0) {
+            try {
+                c.raw = config.at("raw").get<bool>();
+                c.rawMode = cs::VideoMode(cs::VideoMode::kYUYV, 320, 240, 30);
+                if (config.count("width") != 0) c.rawMode.width = config.at("width").get<int>();
+                if (config.count("height") != 0) c.rawMode.height = config.at("height").get<int>();
+                if (config.count("fps") != 0) c.rawMode.fps = config.at("fps").get<int>();
+            } catch (const wpi::json::exception& e) {
+                ParseError() << "camera '" << c.name
+                << "': could not read raw mode: " << e.what() << '\n';
+                return false;
+            }
+        }
+
         // stream properties
         if (config.count("stream") != 0) c.streamConfig = config.at("stream");
 
+        // output settings (optional)
+        c.output.name = c.name + "Cam";
+        if (config.count("output") != 0) {
+            try {
+                auto& output = config.at("output");
+                if (output.count("name") != 0) c.output.name = output.at("name").get<std::string>();
+                if (output.count("width") != 0) c.output.width = output.at("width").get<int>();
+                if (output.count("height") != 0) c.output.height = output.at("height").get<int>();
+                if (output.count("divider") != 0) c.output.frameRateDivider = output.at("divider").get<int>();
+                if (output.count("gray") != 0) c.output.gray = output.at("gray").get<bool>();
+                if (output.count("priority") != 0) c.output.priority = output.at("priority").get<int>();
+                if (output.count("skip static") != 0) c.output.skipStatic = output.at("skip static").get<bool>();
+                if (output.count("keepalive") != 0) c.output.keepAlive = output.at("keepalive").get<int>();
+                if (output.count("decimate") != 0) c.output.decimate = output.at("decimate").get<bool>();
+                if (output.count("passthrough") != 0) c.output.passThrough = output.at("passthrough").get<bool>();
+                if (output.count("core") != 0) c.output.core = output.at("core").get<int>();
+                if (output.count("crop") != 0) {
+                    auto crop = output.at("crop").get<std::vector<int>>();
+                    if (crop.size() != 4) {
+                        ParseError() << "camera '" << c.name << "': crop must be [x, y, width, height]\n";
+                        return false;
+                    }
+                    c.output.crop = cv::Rect(crop[0], crop[1], crop[2], crop[3]);
+                }
+                if (output.count("overlay") != 0) {
+                    for (auto&& item : output.at("overlay")) {
+                        Overlay overlay;
+                        if (!ReadOverlay(c.name, item, overlay)) return false;
+                        c.output.overlays.push_back(overlay);
+                    }
+                }
+            } catch (const wpi::json::exception& e) {
+                ParseError() << "camera '" << c.name
+                << "': could not read output: " << e.what() << '\n';
+                return false;
+            }
+        }
+
+        // scheduling (optional)
+        if (config.count("schedule") != 0) {
+            try {
+                auto& schedule = config.at("schedule");
+                auto& policy = c.output.schedule;
+                if (schedule.count("vision priority") != 0) policy.vision.realtimePriority = schedule.at("vision priority").get<int>();
+                if (schedule.count("vision nice") != 0) policy.vision.nice = schedule.at("vision nice").get<int>();
+                if (schedule.count("deadline") != 0) policy.vision.deadline = schedule.at("deadline").get<double>() / 1000.0;
+                if (schedule.count("stream nice") != 0) policy.stream.nice = schedule.at("stream nice").get<int>();
+            } catch (const wpi::json::exception& e) {
+                ParseError() << "camera '" << c.name
+                << "': could not read schedule: " << e.what() << '\n';
+                return false;
+            }
+        }
+
+        // only the camera settings go to cscore and decide whether the camera
+        // has to be set up again, not the keys read above
         c.config = config;
+        for (const char* key : {"raw", "stream", "output", "schedule"}) c.config.erase(key);
 
-        cameraConfigs.emplace_back(std::move(c));
+        configs.emplace_back(std::move(c));
         return true;
     }
 
+    // Can be run again while running, cameraConfigs is only replaced if the
+    // whole file could be read
     bool ReadConfig() {
         // open config file
         std::error_code ec;
@@ -597,32 +1120,370 @@ namespace {
             }
         }
 
+        // bandwidth (optional)
+        double budget = 0;
+        if (j.count("bandwidth") != 0) {
+            try {
+                budget = j.at("bandwidth").get<double>();
+            } catch (const wpi::json::exception& e) {
+                ParseError() << "could not read bandwidth: " << e.what() << '\n';
+                return false;
+            }
+        }
+
+        // mat pool (optional)
+        double pool = 32;
+        if (j.count("mat pool") != 0) {
+            try {
+                pool = j.at("mat pool").get<double>();
+            } catch (const wpi::json::exception& e) {
+                ParseError() << "could not read mat pool: " << e.what() << '\n';
+                return false;
+            }
+        }
+
         // cameras
+        std::vector<CameraConfig> configs;
         try {
             for (auto&& camera : j.at("cameras")) {
-                if (!ReadCameraConfig(camera)) return false;
+                if (!ReadCameraConfig(camera, configs)) return false;
             }
         } catch (const wpi::json::exception& e) {
             ParseError() << "could not read cameras: " << e.what() << '\n';
             return false;
         }
+        // switch (optional)
+        SwitchConfig streamSwitch;
+        if (j.count("switch") != 0) {
+            try {
+                auto& config = j.at("switch");
+                streamSwitch.name = config.at("name").get<std::string>();
+                if (config.count("port") != 0) streamSwitch.port = config.at("port").get<int>();
+                if (config.count("camera") != 0) streamSwitch.camera = config.at("camera").get<std::string>();
+            } catch (const wpi::json::exception& e) {
+                ParseError() << "could not read switch: " << e.what() << '\n';
+                return false;
+            }
+        }
+
+        // mosaics (optional)
+        std::vector<MosaicConfig> mosaics;
+        if (j.count("mosaics") != 0) {
+            try {
+                for (auto&& mosaic : j.at("mosaics")) {
+                    if (!ReadMosaicConfig(mosaic, mosaics)) return false;
+                }
+            } catch (const wpi::json::exception& e) {
+                ParseError() << "could not read mosaics: " << e.what() << '\n';
+                return false;
+            }
+        }
+
+        // pipelines (optional)
+        std::vector<PipelineConfig> pipelines;
+        if (j.count("pipelines") != 0) {
+            try {
+                for (auto&& pipeline : j.at("pipelines")) {
+                    if (!ReadPipelineConfig(pipeline, pipelines)) return false;
+                }
+            } catch (const wpi::json::exception& e) {
+                ParseError() << "could not read pipelines: " << e.what() << '\n';
+                return false;
+            }
+        }
+        // only a raw camera has YUYV frames for a yuv threshold
+        for (auto& pipeline : pipelines) {
+            if (pipeline.steps.empty() || pipeline.steps[0].kind != PipelineStep::kThreshold ||
+                pipeline.steps[0].range.space != ColorRange::kYuv) {
+                continue;
+            }
+            auto camera = std::find_if(configs.begin(), configs.end(),
+                                       [&](const CameraConfig& c) { return c.name == pipeline.camera; });
+            if (camera != configs.end() && !camera->raw) {
+                ParseError() << "pipeline '" << pipeline.name << "': yuv thresholds need a raw camera\n";
+                return false;
+            }
+        }
+        // pipelines are told apart by name, e.g. their NetworkTables
+        for (size_t i = 0; i < pipelines.size(); ++i) {
+            for (size_t k = 0; k < i; ++k) {
+                if (pipelines[k].name == pipelines[i].name) {
+                    ParseError() << "duplicate pipeline '" << pipelines[i].name << "'\n";
+                    return false;
+                }
+            }
+        }
+
+        cameraConfigs = std::move(configs);
+        mosaicConfigs = std::move(mosaics);
+        pipelineConfigs = std::move(pipelines);
+        switchConfig = streamSwitch;
+        bandwidth = budget;
+        matPool = pool;
         return true;
     }
 
-    cs::UsbCamera StartCamera(const CameraConfig& config) {
+    // A camera that has been started along with its worker
+    struct RunningCamera {
+        CameraConfig config;
+        cs::UsbCamera camera;
+        cs::MjpegServer server;
+        std::unique_ptr<CameraWorker> worker;
+    };
+
+    std::vector<RunningCamera> runningCameras;
+    std::vector<std::unique_ptr<MosaicOutput>> runningMosaics;
+    std::unique_ptr<StreamSwitch> runningSwitch;
+    SwitchConfig runningSwitchConfig;
+
+    // A pipeline and the worker of the camera it runs on
+    struct RunningPipeline {
+        std::shared_ptr<PipelineConsumer<ConfiguredPipeline>> consumer;
+        CameraWorker* worker;
+    };
+
+    std::vector<RunningPipeline> runningPipelines;
+
+    // The centerX, centerY, width, height and area arrays of blobs
+    void PublishBlobs(nt::NetworkTable& table, const std::vector<cv::Rect>& blobs) {
+        std::vector<double> centerX, centerY, width, height, area;
+        for (auto& blob : blobs) {
+            centerX.push_back(blob.x + blob.width / 2.0);
+            centerY.push_back(blob.y + blob.height / 2.0);
+            width.push_back(blob.width);
+            height.push_back(blob.height);
+            area.push_back(blob.area());
+        }
+        table.GetEntry("centerX").SetDoubleArray(centerX);
+        table.GetEntry("centerY").SetDoubleArray(centerY);
+        table.GetEntry("width").SetDoubleArray(width);
+        table.GetEntry("height").SetDoubleArray(height);
+        table.GetEntry("area").SetDoubleArray(area);
+    }
+
+    void StartPipeline(const PipelineConfig& config, CameraWorker& worker) {
+        wpi::outs() << "Starting pipeline '" << config.name << "' on camera '" << config.camera << "'\n";
+        auto table = nt::NetworkTableInstance::GetDefault().GetTable("CameraPipelines")->GetSubTable(config.name);
+        std::unique_ptr<ConfiguredPipeline> pipeline(new ConfiguredPipeline(config));
+        cv::Size input = pipeline->FirstResize();
+        auto consumer = std::make_shared<PipelineConsumer<ConfiguredPipeline>>(std::move(pipeline), nullptr,
+                                                                                std::max(1, config.divider));
+        // the first resize comes from the frame pyramid
+        consumer->SetInputSize(input);
+        consumer->SetNativeYuyv(consumer->GetPipeline().TakesYuyv());
+        consumer->SetName(config.name);
+        consumer->SetResultTable(table);
+        CameraWorker* camera = &worker;
+        // results and all are kept by the listener, so their buffers are reused
+        PipelineResults results;
+        std::vector<cv::Rect> all;
+        consumer->SetFrameListener([table, camera, results, all](ConfiguredPipeline& pipeline,
+                                                                  const Frame& frame) mutable {
+            pipeline.GetResults(frame.image.size(), results);
+            PublishBlobs(*table, results.blobs);
+            all = results.blobs;
+            for (auto& target : results.targets) {
+                PublishBlobs(*table->GetSubTable(target.name), target.blobs);
+                all.insert(all.end(), target.blobs.begin(), target.blobs.end());
+            }
+            camera->SetTargets(all);
+        });
+        worker.AddConsumer(consumer);
+        runningPipelines.push_back(RunningPipeline{consumer, &worker});
+    }
+
+    void StopPipeline(RunningPipeline& running) {
+        wpi::outs() << "Stopping pipeline '" << running.consumer->GetPipeline().GetConfig().name << "'\n";
+        running.worker->RemoveConsumer(running.consumer);
+    }
+
+    void StartCamera(const CameraConfig& config) {
         wpi::outs() << "Starting camera '" << config.name << "' on " << config.path << '\n';
         auto inst = frc::CameraServer::GetInstance();
-        cs::UsbCamera camera{config.name, config.path};
-        auto server = inst->StartAutomaticCapture(camera);
+        RunningCamera running;
+        running.config = config;
+        if (config.raw) {
+            // cscore must leave the device alone
+            running.worker.reset(new CameraWorker(config.name, config.path, config.rawMode, config.output));
+            running.worker->Start();
+            runningCameras.emplace_back(std::move(running));
+            return;
+        }
+        running.camera = cs::UsbCamera{config.name, config.path};
+        running.server = inst->StartAutomaticCapture(running.camera);
 
-        camera.SetConfigJson(config.config);
+        running.camera.SetConfigJson(config.config);
         //  // It takes a while to open a new connection so keep it open
         //  camera.SetConnectionStrategy(cs::VideoSource::kConnectionKeepOpen);
 
         if (config.streamConfig.is_object())
-        server.SetConfigJson(config.streamConfig);
+        running.server.SetConfigJson(config.streamConfig);
+
+        // start a separate image processing worker for the camera
+        running.worker.reset(new CameraWorker(running.camera, config.output));
+        running.worker->Start();
+
+        runningCameras.emplace_back(std::move(running));
+    }
 
-        return camera;
+    void StopCamera(RunningCamera& running) {
+        wpi::outs() << "Stopping camera '" << running.config.name << "'\n";
+        running.worker.reset();
+        if (running.config.raw) return;
+        auto inst = frc::CameraServer::GetInstance();
+        inst->RemoveServer(running.server.GetName());
+        inst->RemoveCamera(running.config.name);
+    }
+
+    // Bring the running cameras in line with cameraConfigs, only touching what
+    // actually changed so the other streams keep flowing
+    void ApplyConfig() {
+        BandwidthGovernor::GetInstance().SetBudget(bandwidth * 1.0e6 / 8);
+        // Cameras starting or changing allocate their buffers
+        MatPool::GetInstance().SetLimit(static_cast<size_t>(std::max(0.0, matPool) * 1048576));
+        MatPool::GetInstance().Unsettle();
+
+        // take the mosaics off the cameras while they change, and stop the
+        // ones that changed themselves
+        for (auto it = runningMosaics.begin(); it != runningMosaics.end();) {
+            (*it)->Detach();
+            auto config = std::find(mosaicConfigs.begin(), mosaicConfigs.end(), (*it)->GetConfig());
+            if (config == mosaicConfigs.end()) {
+                wpi::outs() << "Stopping mosaic '" << (*it)->GetConfig().name << "'\n";
+                it = runningMosaics.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // stop cameras that were removed or moved to another device
+        for (auto it = runningCameras.begin(); it != runningCameras.end();) {
+            auto config = std::find_if(cameraConfigs.begin(), cameraConfigs.end(),
+                [&](const CameraConfig& c) { return c.name == it->config.name; });
+            // a raw camera can only change its mode by opening the device again
+            if (config == cameraConfigs.end() || config->path != it->config.path || config->raw != it->config.raw ||
+                (config->raw && config->rawMode != it->config.rawMode)) {
+                // its pipelines go with it
+                for (auto p = runningPipelines.begin(); p != runningPipelines.end();) {
+                    if (p->worker == it->worker.get()) {
+                        StopPipeline(*p);
+                        p = runningPipelines.erase(p);
+                    } else {
+                        ++p;
+                    }
+                }
+                StopCamera(*it);
+                it = runningCameras.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        for (auto&& config : cameraConfigs) {
+            auto running = std::find_if(runningCameras.begin(), runningCameras.end(),
+                [&](const RunningCamera& r) { return r.config.name == config.name; });
+            if (running == runningCameras.end()) {
+                StartCamera(config);
+                continue;
+            }
+
+            // update the rest in place
+            if (!config.raw && config.config != running->config.config) {
+                wpi::outs() << "Updating camera '" << config.name << "'\n";
+                running->camera.SetConfigJson(config.config);
+                running->worker->CameraChanged();
+            }
+            if (!config.raw && config.streamConfig != running->config.streamConfig && config.streamConfig.is_object())
+                running->server.SetConfigJson(config.streamConfig);
+            running->worker->SetConfig(config.output);
+            running->config = config;
+        }
+
+        // tune pipelines in place if only their parameters changed, build
+        // them again otherwise
+        for (auto it = runningPipelines.begin(); it != runningPipelines.end();) {
+            auto& pipeline = it->consumer->GetPipeline();
+            const PipelineConfig& current = pipeline.GetConfig();
+            auto config = std::find_if(pipelineConfigs.begin(), pipelineConfigs.end(),
+                [&](const PipelineConfig& c) { return c.name == current.name; });
+            bool keep = config != pipelineConfigs.end() && config->camera == current.camera &&
+                        config->divider == current.divider;
+            if (keep && *config != current) {
+                keep = pipeline.Update(*config);
+                if (keep) wpi::outs() << "Updating pipeline '" << config->name << "'\n";
+            }
+            if (keep) {
+                ++it;
+            } else {
+                StopPipeline(*it);
+                it = runningPipelines.erase(it);
+            }
+        }
+        for (auto&& config : pipelineConfigs) {
+            auto running = std::find_if(runningPipelines.begin(), runningPipelines.end(),
+                [&](const RunningPipeline& r) { return r.consumer->GetPipeline().GetConfig().name == config.name; });
+            if (running != runningPipelines.end()) continue;
+            auto camera = std::find_if(runningCameras.begin(), runningCameras.end(),
+                [&](const RunningCamera& r) { return r.config.name == config.camera; });
+            if (camera == runningCameras.end()) {
+                wpi::errs() << "pipeline '" << config.name << "': no camera '" << config.camera << "'\n";
+                continue;
+            }
+            StartPipeline(config, *camera->worker);
+        }
+
+        for (auto&& config : mosaicConfigs) {
+            auto running = std::find_if(runningMosaics.begin(), runningMosaics.end(),
+                [&](const std::unique_ptr<MosaicOutput>& m) { return m->GetConfig() == config; });
+            if (running == runningMosaics.end()) {
+                wpi::outs() << "Starting mosaic '" << config.name << "'\n";
+                runningMosaics.emplace_back(new MosaicOutput(config));
+            }
+        }
+        for (auto&& mosaic : runningMosaics) {
+            for (auto&& tile : mosaic->GetConfig().tiles) {
+                auto camera = std::find_if(runningCameras.begin(), runningCameras.end(),
+                    [&](const RunningCamera& r) { return r.config.name == tile.camera; });
+                if (camera == runningCameras.end()) {
+                    wpi::errs() << "mosaic '" << mosaic->GetConfig().name << "': no camera '" << tile.camera << "'\n";
+                }
+            }
+            for (auto&& camera : runningCameras) mosaic->Attach(camera.config.name, camera.worker->GetHub());
+        }
+
+        if (switchConfig != runningSwitchConfig) {
+            runningSwitch.reset();
+            runningSwitchConfig = switchConfig;
+            if (!switchConfig.name.empty()) {
+                wpi::outs() << "Starting switch '" << switchConfig.name << "'\n";
+                runningSwitch.reset(new StreamSwitch(switchConfig.name, switchConfig.port, switchConfig.camera));
+            }
+        }
+        std::vector<std::pair<std::string, cs::VideoSource>> sources;
+        for (auto&& running : runningCameras) {
+            // keep the cameras streaming while they are not shown, so the
+            // switch does not wait for one to open
+            if (!running.config.raw) {
+                running.camera.SetConnectionStrategy(runningSwitch ? cs::VideoSource::kConnectionKeepOpen
+                                                                   : cs::VideoSource::kConnectionAutoManage);
+            }
+            sources.emplace_back(running.config.name, running.worker->GetStreamSource());
+        }
+        if (runningSwitch) runningSwitch->SetSources(sources);
+    }
+
+    // Set by SIGHUP to ask for the config to be read again
+    volatile std::sig_atomic_t reloadRequested = 0;
+
+    void RequestReload(int) {
+        reloadRequested = 1;
+    }
+
+    // Modification time of the config file, 0 if it cannot be read
+    int64_t ConfigFileTime() {
+        struct stat st;
+        if (stat(configFile, &st) != 0) return 0;
+        return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
     }
 
     // example pipeline
@@ -637,31 +1498,32 @@ namespace {
 }  // namespace
 
 
-/* This function is to reduce the framerate by first only taking every nth frame (n being determined by frameRateDivider),
-and then resizes (if necessary) to width*height, and then outputs that to the cameraServer.
-*/
-void frameReduce (int frameRateDivider, int counter, int width, int height, cv::Mat view, cv::Mat mat, cs::CvSource svr) {
-    // Skip frames (when counter is not 0) to reduce bandwidth
-    counter = (counter + 1) % frameRateDivider;
-    if (!counter) {
-        // Scale the image (if needed) to reduce bandwidth
-        cv::resize(mat, view, cv::Size(width, height), 0.0, 0.0, cv::INTER_AREA);
-        // Give the output stream a new image to display
-        svr.PutFrame(view);
-    }
-}
-
 int main(int argc, char* argv[]) {
 
     if (argc >= 2) configFile = argv[1];
 
+    // reuse image buffers rather than going to the heap for every frame
+    MatPool::GetInstance().Install();
+
     // read configuration
     if (!ReadConfig()) return EXIT_FAILURE;
 
+    // start NetworkTables
+    auto ntinst = nt::NetworkTableInstance::GetDefault();
+    if (server) {
+        wpi::outs() << "Setting up NetworkTables server\n";
+        ntinst.StartServer();
+    } else {
+        wpi::outs() << "Setting up NetworkTables client for team " << team << '\n';
+        ntinst.StartClientTeam(team);
+    }
+
     // start cameras
-    std::vector<cs::VideoSource> cameras;
-    for (auto&& cameraConfig : cameraConfigs)
-    cameras.emplace_back(StartCamera(cameraConfig));
+    int64_t configTime = ConfigFileTime();
+    ApplyConfig();
+
+    // read the config again on SIGHUP or when the file changes
+    std::signal(SIGHUP, RequestReload);
 
     //
     // On a Raspberry Pi 3B+, if all the USB ports connect to USB cameras then the
@@ -686,90 +1548,6 @@ int main(int argc, char* argv[]) {
     //frontCamera.setWhiteBalanceHoldCurrent();
     //frontCamera.setExposureManual(15);
 
-    // start separate image processing threads for each camera if present
-    if (cameras.size() >= 1) {
-
-    // c.name = config.at("name").get<std::string>();
-    // auto str = cameras.at("name").get<std::string>();
-    // wpi::StringRef s(str);
-    // if (s.equals_lower("front")) {
-
-        // test
-        
-        // Thread for the first camera
-        std::thread([&] {
-            // Control bandwidth by defining output resolution and camera frame rate divider
-            const double kWidth = 320.0;
-            const double kHeight = 240.0;
-            const int kFrameRateDivider = 2;
-
-            // Front facing drive camera. We just want to draw cross hairs on this.
-            cs::CvSink FrontCam = frc::CameraServer::GetInstance()->GetVideo(cameras[0]);
-            // Setup a CvSource. This will send images back to the Dashboard
-            cs::CvSource frontSvr =
-            frc::CameraServer::GetInstance()->PutVideo("FrontCam", kWidth, kHeight);
-            // FrontSvr.SetFPS(10); // This does not seem to work
-
-            // Create mats to hold images
-            cv::Mat frontMat;
-            cv::Mat frontView;
-            int counter = 0;
-
-            while (true) {
-                    // Tell the CvSink to grab a frame from the camera and put it
-                    // in the source mat.  If there is an error notify the output.
-                    if (FrontCam.GrabFrame(frontMat) == 0) {
-                    // Send error to the output
-                    frontSvr.NotifyError(FrontCam.GetError());
-                    // skip the rest of the current iteration
-                    continue;
-                }
-                // call earlier function to reduce frames sent
-                frameReduce(kFrameRateDivider, counter, kWidth, kHeight, frontView, frontMat, frontSvr);
-            }
-        }).detach();
-    }
-
-    // Thread for second camera if it exists
-    if (cameras.size() >= 2) {
-
-        // c.name = config.at("name").get<std::string>();
-        // auto str = cameras.at("name").get<std::string>();
-        // wpi::StringRef s(str);
-        // if (s.equals_lower("back")) {
-
-        std::thread([&] {
-            // Control bandwidth by defining output resolution and camera frame rate divider
-            const double kWidth = 320.0;
-            const double kHeight = 240.0;
-            const int kFrameRateDivider = 2;
-
-            // Back facing drive camera. We just want to draw cross hairs on this.
-            cs::CvSink BackCam = frc::CameraServer::GetInstance()->GetVideo(cameras[1]);
-            // Setup a CvSource. This will send images back to the Dashboard
-            cs::CvSource backSvr =
-            frc::CameraServer::GetInstance()->PutVideo("BackCam", kWidth, kHeight);
-            // BackSvr.SetFPS(10); // This does not seem to work
-
-            // Create mats to hold images
-            cv::Mat backMat;
-            cv::Mat backView;
-            int counter = 0;
-
-            while (true) {
-                // Tell the CvSink to grab a frame from the camera and put it
-                // in the source mat.  If there is an error notify the output.
-                if (BackCam.GrabFrame(backMat) == 0) {
-                    // Send error to the output
-                    backSvr.NotifyError(BackCam.GetError());
-                    // skip the rest of the current iteration
-                    continue;
-                }
-                frameReduce(kFrameRateDivider, counter, kWidth, kHeight, backView, backMat, backSvr);
-            }
-        }).detach();
-    } 
-
     std::thread([&] {
         LIDARLite_v3 myLidarLite;
         __u16 distance;
@@ -799,6 +1577,21 @@ int main(int argc, char* argv[]) {
         }
     }).detach();
 
-    // loop forever
-    for (;;) std::this_thread::sleep_for(std::chrono::seconds(10));
+    // loop forever, publishing the camera metrics and keeping the streams in
+    // their bandwidth once a second, and checking no Mat keeps allocating
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        for (auto&& running : runningCameras) running.worker->PublishMetrics();
+        BandwidthGovernor::GetInstance().Update();
+        MatPool::GetInstance().Publish();
+        Scheduler::GetInstance().Publish();
+
+        int64_t time = ConfigFileTime();
+        if (reloadRequested || (time != 0 && time != configTime)) {
+            reloadRequested = 0;
+            configTime = time;
+            wpi::outs() << "Reloading '" << configFile << "'\n";
+            if (ReadConfig()) ApplyConfig();
+        }
+    }
 }